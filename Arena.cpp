@@ -0,0 +1,50 @@
+#include "Arena.h"
+
+// Must be O(1)
+Arena::Arena()
+{
+	m_next = nullptr;
+	m_remaining = 0;
+}
+
+Arena::~Arena()
+{
+	clear();
+}
+
+// Must be O(number of slabs)
+void Arena::clear()
+{
+	for (unsigned int i = 0; i < m_slabs.size(); i++)
+		delete[] m_slabs[i];
+
+	m_slabs.clear();
+	m_next = nullptr;
+	m_remaining = 0;
+}
+
+// Must be O(1)
+void* Arena::allocate(size_t bytes, size_t alignment)
+{
+	size_t padding = (alignment - reinterpret_cast<size_t>(m_next) % alignment) % alignment;
+	if (m_next != nullptr && padding + bytes <= m_remaining)
+	{
+		char *result = m_next + padding;
+		m_next += padding + bytes;
+		m_remaining -= padding + bytes;
+		return result;
+	}
+
+	// Big requests get a slab of their own, so the current one keeps its
+	// free space. new[] memory is aligned for any fundamental type
+	if (bytes > SLAB_SIZE / 4)
+	{
+		m_slabs.push_back(new char[bytes]);
+		return m_slabs.back();
+	}
+
+	m_slabs.push_back(new char[SLAB_SIZE]);
+	m_next = m_slabs.back() + bytes;
+	m_remaining = SLAB_SIZE - bytes;
+	return m_slabs.back();
+}
@@ -0,0 +1,33 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <vector>
+#include <cstddef>
+
+// Bump allocator for lots of small objects that all go away together (the
+// nodes of an index). Memory is carved out of large slabs and only handed
+// back all at once by clear() or the destructor, so whatever lives in an
+// Arena must not need its destructor run.
+class Arena
+{
+public:
+	Arena();
+	~Arena();
+	void clear();
+	void* allocate(size_t bytes, size_t alignment = 8);  // alignment: a power of 2
+
+private:
+	// Prevents Arenas from being copied or assigned
+	Arena(const Arena& other);
+	Arena& operator=(const Arena& rhs);
+
+	static const size_t SLAB_SIZE = 64 * 1024;
+
+	// Private data members
+	std::vector<char*> m_slabs;
+	char *m_next;  // free space left in the newest regular slab
+	size_t m_remaining;
+
+};
+
+#endif  // ARENA_H
@@ -0,0 +1,538 @@
+#include "BPlusTree.h"
+#include <algorithm>
+
+// Ordering for searching an internal node's std::string keys with a StringRef
+static bool refLess(const StringRef& lhs, const std::string& rhs)
+{
+	return lhs < StringRef(rhs);
+}
+
+// Must be O(1)
+BPlusTree::Iterator::Iterator()
+{
+	m_leaf = nullptr;
+	m_keyIndex = m_valueIndex = 0;
+	m_valid = false;
+}
+
+// Starts on the first duplicate of the key, or on the last one when atTail
+// is set (used by findEqualOrPredecessor, same as MultiMap's tail iterator)
+BPlusTree::Iterator::Iterator(Node *leaf, unsigned int keyIndex, bool atTail)
+{
+	m_leaf = leaf;
+	m_keyIndex = keyIndex;
+	m_valueIndex = atTail ? m_leaf->numValues(keyIndex) - 1 : 0;
+	m_valid = true;
+}
+
+bool BPlusTree::Iterator::valid() const
+{
+	return m_valid;
+}
+
+// Must be O(1)
+StringRef BPlusTree::Iterator::getKey() const
+{
+	if (!valid())
+		return StringRef("ERROR");
+
+	return m_leaf->leafKey(m_keyIndex);
+}
+
+unsigned int BPlusTree::Iterator::getValue() const
+{
+	if (!valid())
+		return -1;
+
+	return m_leaf->values[m_keyIndex][m_valueIndex];
+}
+
+bool BPlusTree::Iterator::next()
+{
+	if (!valid())
+		return false;
+
+	// Remaining duplicates of the current key
+	if (m_valueIndex + 1 < m_leaf->numValues(m_keyIndex))
+	{
+		m_valueIndex++;
+		return true;
+	}
+
+	// Next key in the same leaf
+	m_valueIndex = 0;
+	if (m_keyIndex + 1 < m_leaf->numKeys())
+	{
+		m_keyIndex++;
+		return true;
+	}
+
+	// First key of the next leaf over
+	m_leaf = m_leaf->next;
+	m_keyIndex = 0;
+	if (m_leaf == nullptr)
+	{
+		invalidateIterator();
+		return false;
+	}
+
+	return true;
+}
+
+bool BPlusTree::Iterator::prev()
+{
+	if (!valid())
+		return false;
+
+	if (m_valueIndex > 0)
+	{
+		m_valueIndex--;
+		return true;
+	}
+
+	if (m_keyIndex > 0)
+	{
+		m_keyIndex--;
+		m_valueIndex = m_leaf->numValues(m_keyIndex) - 1;
+		return true;
+	}
+
+	m_leaf = m_leaf->prev;
+	if (m_leaf == nullptr)
+	{
+		invalidateIterator();
+		return false;
+	}
+
+	m_keyIndex = m_leaf->numKeys() - 1;
+	m_valueIndex = m_leaf->numValues(m_keyIndex) - 1;
+	return true;
+}
+
+// Must be O(1)
+BPlusTree::BPlusTree()
+{
+	m_root = nullptr;
+}
+
+// Must be O(N)
+BPlusTree::~BPlusTree()
+{
+	clear();
+}
+
+// Must be O(N)
+void BPlusTree::clear()
+{
+	clearTree(m_root);
+	m_root = nullptr;
+}
+
+// Must be O(log N)
+void BPlusTree::insert(const StringRef& key, unsigned int value)
+{
+	// Check for empty tree
+	if (m_root == nullptr)
+		m_root = new Node(true);
+
+	std::string splitKey;
+	Node *splitNode = nullptr;
+
+	// If the root itself split, grow the tree by one level
+	if (insertIntoNode(m_root, key, value, splitKey, splitNode))
+	{
+		Node *newRoot = new Node(false);
+		newRoot->keys.push_back(splitKey);
+		newRoot->children.push_back(m_root);
+		newRoot->children.push_back(splitNode);
+		newRoot->size = m_root->size + splitNode->size;
+		m_root = newRoot;
+	}
+}
+
+// Must be O(N). Replaces the contents with the (key, value) pairs in sorted,
+// which must be ordered by key and then by value. Leaves are packed full
+// and each level above is built from the one below, instead of splitting
+// our way there one insert at a time
+void BPlusTree::bulkLoad(const std::vector<std::pair<StringRef, unsigned int> >& sorted)
+{
+	clear();
+
+	unsigned int distinct = 0;
+	for (unsigned int i = 0; i < sorted.size(); i++)
+	{
+		if (i == 0 || sorted[i].first != sorted[i - 1].first)
+			distinct++;
+	}
+
+	if (distinct == 0)
+		return;
+
+	// Spread the keys evenly so no leaf ends up nearly empty
+	unsigned int numLeaves = (distinct + ORDER - 1) / ORDER;
+	std::vector<Node*> level;
+	std::vector<std::string> levelMinKeys;  // smallest key under each node of level
+	unsigned int next = 0;
+
+	for (unsigned int l = 0; l < numLeaves; l++)
+	{
+		unsigned int keysInLeaf = distinct / numLeaves + (l < distinct % numLeaves ? 1 : 0);
+		Node *leaf = new Node(true);
+
+		for (unsigned int k = 0; k < keysInLeaf; k++)
+		{
+			const StringRef& key = sorted[next].first;
+			leaf->keyBytes.insert(leaf->keyBytes.end(), key.data, key.data + key.size);
+			leaf->keyOffsets.push_back(leaf->keyBytes.size());
+
+			leaf->values.push_back(std::vector<unsigned int>());
+			std::vector<unsigned int>& postings = leaf->values.back();
+			do
+			{
+				postings.push_back(sorted[next].second);
+				next++;
+			} while (next < sorted.size() && sorted[next].first == sorted[next - 1].first);
+
+			leaf->size += postings.size();
+		}
+
+		if (!level.empty())
+		{
+			leaf->prev = level.back();
+			level.back()->next = leaf;
+		}
+		level.push_back(leaf);
+		levelMinKeys.push_back(leaf->leafKey(0).str());
+	}
+
+	// Each pass groups up to ORDER + 1 nodes under a new parent
+	while (level.size() > 1)
+	{
+		unsigned int numParents = (level.size() + ORDER) / (ORDER + 1);
+		std::vector<Node*> parents;
+		std::vector<std::string> parentMinKeys;
+		unsigned int child = 0;
+
+		for (unsigned int p = 0; p < numParents; p++)
+		{
+			unsigned int numChildren = level.size() / numParents +
+				(p < level.size() % numParents ? 1 : 0);
+			Node *parent = new Node(false);
+
+			parentMinKeys.push_back(levelMinKeys[child]);
+			for (unsigned int c = 0; c < numChildren; c++, child++)
+			{
+				if (c > 0)
+					parent->keys.push_back(levelMinKeys[child]);
+				parent->children.push_back(level[child]);
+				parent->size += level[child]->size;
+			}
+			parents.push_back(parent);
+		}
+
+		level.swap(parents);
+		levelMinKeys.swap(parentMinKeys);
+	}
+
+	m_root = level[0];
+}
+
+// Must be O(log N)
+BPlusTree::Iterator BPlusTree::findEqual(const std::string& key) const
+{
+	Node *leaf = findLeaf(key);
+	Iterator it;
+
+	if (leaf == nullptr)
+		return it;
+
+	unsigned int pos = leafLowerBound(leaf, key);
+
+	if (pos < leaf->numKeys() && leaf->leafKey(pos) == StringRef(key))
+	{
+		Iterator validIt(leaf, pos, false);
+		return validIt;
+	}
+
+	return it;
+}
+
+// Must be O(log N)
+BPlusTree::Iterator BPlusTree::findEqualOrSuccessor(const std::string& key) const
+{
+	Node *leaf = findLeaf(key);
+	Iterator it;
+
+	if (leaf == nullptr)
+		return it;
+
+	unsigned int pos = leafLowerBound(leaf, key);
+
+	// Every key in this leaf is smaller, so the successor starts the next leaf
+	if (pos == leaf->numKeys())
+	{
+		leaf = leaf->next;
+		pos = 0;
+		if (leaf == nullptr)
+			return it;
+	}
+
+	Iterator validIt(leaf, pos, false);
+	return validIt;
+}
+
+// Must be O(log N)
+BPlusTree::Iterator BPlusTree::findEqualOrPredecessor(const std::string& key) const
+{
+	Node *leaf = findLeaf(key);
+	Iterator it;
+
+	if (leaf == nullptr)
+		return it;
+
+	unsigned int pos = leafUpperBound(leaf, key);
+
+	// Every key in this leaf is larger, so the predecessor ends the previous leaf
+	if (pos == 0)
+	{
+		leaf = leaf->prev;
+		if (leaf == nullptr)
+			return it;
+		pos = leaf->numKeys();
+	}
+
+	Iterator validIt(leaf, pos - 1, true);
+	return validIt;
+}
+
+// Must be O(1). Total number of values, duplicates included
+unsigned int BPlusTree::size() const
+{
+	return m_root == nullptr ? 0 : m_root->size;
+}
+
+// Must be O(log N). Number of values under keys < key
+unsigned int BPlusTree::countLess(const std::string& key) const
+{
+	return rank(key, false);
+}
+
+// Must be O(log N). Number of values under keys <= key
+unsigned int BPlusTree::countLessOrEqual(const std::string& key) const
+{
+	return rank(key, true);
+}
+
+// Must be O(log N). Number of values under keys in [min, max]
+unsigned int BPlusTree::countRange(const std::string& min, const std::string& max) const
+{
+	if (max < min)
+		return 0;
+
+	return countLessOrEqual(max) - countLess(min);
+}
+
+/////////////////////
+/* PRIVATE METHODS */
+/////////////////////
+
+void BPlusTree::Iterator::invalidateIterator()
+{
+	m_valid = false;
+}
+
+// Descends to the leaf whose key range covers key
+BPlusTree::Node* BPlusTree::findLeaf(const std::string& key) const
+{
+	Node *cur = m_root;
+
+	while (cur != nullptr && !cur->leaf)
+	{
+		unsigned int child = std::upper_bound(cur->keys.begin(), cur->keys.end(), key) -
+			cur->keys.begin();
+		cur = cur->children[child];
+	}
+
+	return cur;
+}
+
+// Same descent as findLeaf, adding up the sizes of every child passed over.
+// Children left of the one taken only hold keys smaller than key
+unsigned int BPlusTree::rank(const std::string& key, bool inclusive) const
+{
+	Node *cur = m_root;
+	unsigned int count = 0;
+
+	if (cur == nullptr)
+		return 0;
+
+	while (!cur->leaf)
+	{
+		unsigned int child = std::upper_bound(cur->keys.begin(), cur->keys.end(), key) -
+			cur->keys.begin();
+		for (unsigned int i = 0; i < child; i++)
+			count += cur->children[i]->size;
+		cur = cur->children[child];
+	}
+
+	unsigned int pos = inclusive ? leafUpperBound(cur, key) : leafLowerBound(cur, key);
+	for (unsigned int i = 0; i < pos; i++)
+		count += cur->values[i].size();
+
+	return count;
+}
+
+// Index of the leaf's first key that is not less than key
+unsigned int BPlusTree::leafLowerBound(const Node *leaf, const StringRef& key)
+{
+	unsigned int lo = 0;
+	unsigned int hi = leaf->numKeys();
+	while (lo < hi)
+	{
+		unsigned int mid = lo + (hi - lo) / 2;
+		if (leaf->leafKey(mid) < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+// Index of the leaf's first key that is greater than key
+unsigned int BPlusTree::leafUpperBound(const Node *leaf, const StringRef& key)
+{
+	unsigned int lo = 0;
+	unsigned int hi = leaf->numKeys();
+	while (lo < hi)
+	{
+		unsigned int mid = lo + (hi - lo) / 2;
+		if (key < leaf->leafKey(mid))
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return lo;
+}
+
+// Returns true if cur had to split, in which case splitNode is the new right
+// sibling and splitKey the smallest key reachable through it
+bool BPlusTree::insertIntoNode(Node *cur, const StringRef& key, unsigned int value,
+	std::string& splitKey, Node*& splitNode)
+{
+	// The new value ends up somewhere below cur whatever happens
+	cur->size++;
+
+	if (cur->leaf)
+	{
+		unsigned int index = leafLowerBound(cur, key);
+		unsigned int numKeys = cur->numKeys();
+
+		// For duplicate key values
+		if (index < numKeys && cur->leafKey(index) == key)
+		{
+			cur->values[index].push_back(value);
+			return false;
+		}
+
+		// Open a gap for the key's bytes, and shift the offsets of every key
+		// after it past the gap
+		cur->keyBytes.insert(cur->keyBytes.begin() + cur->keyOffsets[index],
+			key.data, key.data + key.size);
+		cur->keyOffsets.insert(cur->keyOffsets.begin() + index + 1,
+			cur->keyOffsets[index] + key.size);
+		for (unsigned int i = index + 2; i <= numKeys + 1; i++)
+			cur->keyOffsets[i] += key.size;
+		cur->values.insert(cur->values.begin() + index, std::vector<unsigned int>(1, value));
+
+		if (cur->numKeys() <= ORDER)
+			return false;
+
+		// Move the upper half into a new leaf and link it in after cur
+		unsigned int half = cur->numKeys() / 2;
+		unsigned int keyStart = cur->keyOffsets[half];
+		splitNode = new Node(true);
+		splitNode->keyBytes.assign(cur->keyBytes.begin() + keyStart, cur->keyBytes.end());
+		for (unsigned int i = half + 1; i < cur->keyOffsets.size(); i++)
+			splitNode->keyOffsets.push_back(cur->keyOffsets[i] - keyStart);
+		splitNode->values.resize(cur->values.size() - half);
+		for (unsigned int i = half; i < cur->values.size(); i++)
+			splitNode->values[i - half].swap(cur->values[i]);
+		cur->keyBytes.resize(keyStart);
+		cur->keyOffsets.resize(half + 1);
+		cur->values.resize(half);
+
+		for (unsigned int i = 0; i < splitNode->values.size(); i++)
+			splitNode->size += splitNode->values[i].size();
+		cur->size -= splitNode->size;
+
+		splitNode->next = cur->next;
+		splitNode->prev = cur;
+		if (cur->next != nullptr)
+			cur->next->prev = splitNode;
+		cur->next = splitNode;
+
+		splitKey = splitNode->leafKey(0).str();
+		return true;
+	}
+
+	unsigned int child = std::upper_bound(cur->keys.begin(), cur->keys.end(), key, refLess) -
+		cur->keys.begin();
+
+	std::string childSplitKey;
+	Node *childSplitNode = nullptr;
+	if (!insertIntoNode(cur->children[child], key, value, childSplitKey, childSplitNode))
+		return false;
+
+	cur->keys.insert(cur->keys.begin() + child, childSplitKey);
+	cur->children.insert(cur->children.begin() + child + 1, childSplitNode);
+
+	if (cur->keys.size() <= ORDER)
+		return false;
+
+	// The middle key moves up; everything right of it goes to the new node
+	unsigned int mid = cur->keys.size() / 2;
+	splitKey = cur->keys[mid];
+	splitNode = new Node(false);
+	splitNode->keys.assign(cur->keys.begin() + mid + 1, cur->keys.end());
+	splitNode->children.assign(cur->children.begin() + mid + 1, cur->children.end());
+	cur->keys.resize(mid);
+	cur->children.resize(mid + 1);
+
+	for (unsigned int i = 0; i < splitNode->children.size(); i++)
+		splitNode->size += splitNode->children[i]->size;
+	cur->size -= splitNode->size;
+
+	return true;
+}
+
+void BPlusTree::clearTree(Node *cur)
+{
+	if (cur == nullptr)
+		return;
+
+	for (unsigned int i = 0; i < cur->children.size(); i++)
+		clearTree(cur->children[i]);
+
+	delete cur;
+}
+
+////////////////////
+/* TEST FUNCTIONS */
+////////////////////
+
+void BPlusTree::testPrintInit()
+{
+	// Left most leaf, then follow the leaf links
+	Node *cur = m_root;
+	while (cur != nullptr && !cur->leaf)
+		cur = cur->children[0];
+
+	for (; cur != nullptr; cur = cur->next)
+	{
+		for (unsigned int i = 0; i < cur->numKeys(); i++)
+		{
+			for (unsigned int k = 0; k < cur->values[i].size(); k++)
+				std::cerr << cur->leafKey(i) << " : " << cur->values[i][k] << std::endl;
+		}
+	}
+}
@@ -0,0 +1,121 @@
+#ifndef BPLUSTREE_H
+#define BPLUSTREE_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include "StringRef.h"
+
+// Alternative index engine to MultiMap. Keys live side by side in wide nodes
+// and the leaves are linked, so a range scan walks contiguous memory instead
+// of chasing one heap node per key.
+class BPlusTree
+{
+public:
+	// Maximum number of keys held by any node before it splits
+	static const unsigned int ORDER = 64;
+
+	struct Node
+	{
+		Node(bool isLeaf)
+		{
+			leaf = isLeaf;
+			next = prev = nullptr;
+			size = 0;
+			if (leaf)
+			{
+				keyOffsets.reserve(ORDER + 2);
+				keyOffsets.push_back(0);
+				values.reserve(ORDER + 1);
+			}
+			else
+				keys.reserve(ORDER + 1);
+		}
+		unsigned int numKeys() const
+		{
+			return leaf ? keyOffsets.size() - 1 : keys.size();
+		}
+		// Leaf nodes only
+		StringRef leafKey(unsigned int i) const
+		{
+			return StringRef(keyBytes.data() + keyOffsets[i], keyOffsets[i + 1] - keyOffsets[i]);
+		}
+		unsigned int numValues(unsigned int i) const
+		{
+			return values[i].size();
+		}
+		bool leaf;
+		// Internal nodes only: children[i] holds keys < keys[i] <= children[i + 1]
+		std::vector<std::string> keys;
+		std::vector<Node*> children;
+		// Leaf nodes only: key i is keyBytes[keyOffsets[i], keyOffsets[i + 1])
+		// (one buffer instead of a string per key, so there is always one more
+		// offset than there are keys), and values[i] is every row id inserted
+		// under it, in insertion order. Postings stay one vector per key so a
+		// duplicate is a push_back however many rows the leaf already holds
+		std::vector<char> keyBytes;
+		std::vector<unsigned int> keyOffsets;
+		std::vector<std::vector<unsigned int> > values;
+		Node *next, *prev;
+		// Number of values (not keys) in the subtree rooted here
+		unsigned int size;
+	};
+
+	class Iterator
+	{
+	public:
+		Iterator();
+		Iterator(Node *leaf, unsigned int keyIndex, bool atTail);
+		bool valid() const;
+		StringRef getKey() const;
+		unsigned int getValue() const;
+		bool next();
+		bool prev();
+
+	private:
+		// Private methods
+		void invalidateIterator();
+
+		// Private data members
+		Node *m_leaf;
+		unsigned int m_keyIndex;
+		unsigned int m_valueIndex;
+		bool m_valid;
+	};
+
+	BPlusTree();
+	~BPlusTree();
+	void clear();
+	void insert(const StringRef& key, unsigned int value);
+	void bulkLoad(const std::vector<std::pair<StringRef, unsigned int> >& sorted);
+	Iterator findEqual(const std::string& key) const;
+	Iterator findEqualOrSuccessor(const std::string& key) const;
+	Iterator findEqualOrPredecessor(const std::string& key) const;
+	unsigned int size() const;
+	unsigned int countLess(const std::string& key) const;
+	unsigned int countLessOrEqual(const std::string& key) const;
+	unsigned int countRange(const std::string& min, const std::string& max) const;
+
+	// Test printing
+	void testPrintInit();
+
+private:
+	// Prevents BPlusTrees from being copied or assigned
+	BPlusTree(const BPlusTree& other);
+	BPlusTree& operator=(const BPlusTree& rhs);
+
+	// Private methods
+	Node* findLeaf(const std::string& key) const;
+	static unsigned int leafLowerBound(const Node *leaf, const StringRef& key);
+	static unsigned int leafUpperBound(const Node *leaf, const StringRef& key);
+	unsigned int rank(const std::string& key, bool inclusive) const;
+	bool insertIntoNode(Node *cur, const StringRef& key, unsigned int value,
+		std::string& splitKey, Node*& splitNode);
+	void clearTree(Node *cur);
+
+	// Private data members
+	Node* m_root;
+
+};
+
+#endif  // BPLUSTREE_H
@@ -0,0 +1,555 @@
+#include "ColumnStore.h"
+#include <algorithm>  // for lower_bound
+#include <cassert>
+
+// Must be O(1)
+ColumnStore::ColumnStore()
+{
+	m_mappedBase = nullptr;
+	m_numMappedRows = 0;
+	m_numRows = 0;
+	m_external = false;
+}
+
+// Drops every stored row and sets up one empty column per field
+void ColumnStore::reset(unsigned int numColumns)
+{
+	m_columns.clear();
+	m_columns.resize(numColumns);
+	for (unsigned int i = 0; i < numColumns; i++)
+		syncData(m_columns[i]);
+	m_mappedBase = nullptr;
+	m_numMappedRows = 0;
+	m_numRows = 0;
+	m_external = false;
+}
+
+// Must be O(1). Every column's views stay valid, they move with its vectors
+void ColumnStore::swap(ColumnStore& other)
+{
+	m_columns.swap(other.m_columns);
+	std::swap(m_mappedBase, other.m_mappedBase);
+	std::swap(m_numMappedRows, other.m_numMappedRows);
+	std::swap(m_numRows, other.m_numRows);
+	std::swap(m_external, other.m_external);
+}
+
+unsigned int ColumnStore::getNumColumns() const
+{
+	return m_columns.size();
+}
+
+unsigned int ColumnStore::getNumRows() const
+{
+	return m_numRows;
+}
+
+// Only call before any row is appended
+void ColumnStore::setColumnType(unsigned int column, TypedValue::Type type)
+{
+	m_columns[column].type = type;
+}
+
+TypedValue::Type ColumnStore::getColumnType(unsigned int column) const
+{
+	return m_columns[column].type;
+}
+
+// Caller guarantees row.size() == getNumColumns()
+void ColumnStore::appendRow(const std::vector<std::string>& row)
+{
+	if (m_external)
+		copyExternalColumns();
+
+	for (unsigned int i = 0; i < m_columns.size(); i++)
+		appendCell(m_columns[i], row[i]);
+
+	m_numRows++;
+}
+
+// Same as above for values that are views into some other buffer (they are
+// copied into the arenas). row must hold getNumColumns() values
+void ColumnStore::appendRow(const StringRef *row)
+{
+	if (m_external)
+		copyExternalColumns();
+
+	for (unsigned int i = 0; i < m_columns.size(); i++)
+		appendCell(m_columns[i], row[i]);
+
+	m_numRows++;
+}
+
+// Sets the buffer that appendMappedRow views point into
+void ColumnStore::attachMapping(const char *base)
+{
+	m_mappedBase = base;
+}
+
+// Records where each value of row sits inside the attached buffer without
+// copying any bytes. Returns false once arena rows have been appended,
+// because mapped rows have to come first. Encoded columns (and ones that
+// were, which hold every row in their arena) just take the row's code
+bool ColumnStore::appendMappedRow(const StringRef *row)
+{
+	if (m_numRows != m_numMappedRows)
+		return false;
+
+	if (m_external)
+		copyExternalColumns();
+
+	for (unsigned int i = 0; i < m_columns.size(); i++)
+	{
+		Column& col = m_columns[i];
+		if (col.encoded || col.numMappedRows != m_numMappedRows)
+		{
+			appendCell(col, row[i]);
+			continue;
+		}
+
+		col.mappedBegins.push_back(row[i].data - m_mappedBase);
+		col.mappedSizes.push_back(row[i].size);
+		col.numMappedRows++;
+		appendValue(col, row[i]);
+		syncData(col);
+	}
+
+	m_numMappedRows++;
+	m_numRows++;
+	return true;
+}
+
+void ColumnStore::getRow(unsigned int rowNum, std::vector<std::string>& row) const
+{
+	row.resize(m_columns.size());
+	for (unsigned int i = 0; i < m_columns.size(); i++)
+	{
+		StringRef cell = getCell(rowNum, i);
+		row[i].assign(cell.data, cell.size);
+	}
+}
+
+// Must be O(N). Appends every row whose value is in [min, max] (min <= max),
+// in row order. The comparison loop is branch free and only touches one
+// contiguous array, so the compiler can vectorize it; its hits are then
+// compacted without branching either. Unsigned is the unsigned type as wide
+// as Value
+template <typename Value, typename Unsigned>
+static void scanBlocks(const Value *values, unsigned int numValues, Value min, Value max,
+	std::vector<int>& rows)
+{
+	const unsigned int BLOCK = 4096;
+	unsigned char hits[BLOCK];
+
+	// min <= v <= max as a single unsigned compare: anything below min wraps
+	// around to more than width
+	Unsigned width = static_cast<Unsigned>(static_cast<Unsigned>(max) - static_cast<Unsigned>(min));
+
+	for (unsigned int start = 0; start < numValues; start += BLOCK)
+	{
+		unsigned int count = numValues - start < BLOCK ? numValues - start : BLOCK;
+		const Value *block = values + start;
+
+		unsigned int numHits = 0;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			hits[i] = static_cast<Unsigned>(static_cast<Unsigned>(block[i]) - static_cast<Unsigned>(min)) <= width;
+			numHits += hits[i];
+		}
+
+		if (numHits == 0)
+			continue;
+
+		size_t base = rows.size();
+		rows.resize(base + count);
+		int *out = &rows[base];
+		unsigned int k = 0;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			out[k] = start + i;
+			k += hits[i];
+		}
+		rows.resize(base + k);
+	}
+}
+
+// Must be O(N). Every row of a typed column whose value is in [min, max]
+void ColumnStore::scanValues(unsigned int column, long long min, long long max,
+	std::vector<int>& rows) const
+{
+	if (min <= max)
+		scanBlocks<long long, unsigned long long>(m_columns[column].valueData, m_numRows, min, max, rows);
+}
+
+// Must be O(N). Every row of an encoded column whose code is in [min, max]
+void ColumnStore::scanCodes(unsigned int column, unsigned int min, unsigned int max,
+	std::vector<int>& rows) const
+{
+	unsigned int numCodes = getDictionarySize(column);
+	if (max >= numCodes)
+		max = numCodes - 1;
+
+	if (min <= max)
+	{
+		scanBlocks<unsigned short, unsigned short>(m_columns[column].codeData, m_numRows,
+			static_cast<unsigned short>(min), static_cast<unsigned short>(max), rows);
+	}
+}
+
+// Must be O(N). String counterpart of scanValues, min and max are null when
+// not bounded. The cells are read in storage order, so the scan streams
+// through the arena (or the mapping) instead of jumping around it
+void ColumnStore::scanCells(unsigned int column, const StringRef *min, const StringRef *max,
+	std::vector<int>& rows) const
+{
+	for (unsigned int row = 0; row < m_numRows; row++)
+	{
+		StringRef cell = getCell(row, column);
+		if ((min == nullptr || *min <= cell) && (max == nullptr || cell <= *max))
+			rows.push_back(row);
+	}
+}
+
+// Copies the columns of an opened snapshot out of its memory so they can
+// change
+void ColumnStore::copyExternalColumns()
+{
+	for (unsigned int i = 0; i < m_columns.size(); i++)
+	{
+		Column& col = m_columns[i];
+		if (!col.external)
+			continue;
+
+		unsigned int numEntries = col.encoded ? col.dictionarySize : m_numRows;
+		col.offsets.assign(col.offsetData, col.offsetData + numEntries + 1);
+		col.arena.assign(col.arenaData, col.arenaData + col.offsetData[numEntries]);
+		if (col.encoded)
+			col.codes.assign(col.codeData, col.codeData + m_numRows);
+		if (col.type != TypedValue::vt_string)
+			col.values.assign(col.valueData, col.valueData + m_numRows);
+
+		col.external = false;
+		syncData(col);
+	}
+
+	m_external = false;
+}
+
+// Must be O(N log D) for D distinct values. Encodes the column if it has at
+// most MAX_ENCODED_VALUES distinct values and they repeat enough for it to
+// be worth it. Returns whether the column is encoded. Columns are encoded
+// in parallel, so the copy out of a snapshot (which touches every column)
+// has to have been made already
+bool ColumnStore::encodeColumn(unsigned int column)
+{
+	assert(!m_external);
+
+	Column& col = m_columns[column];
+	if (col.encoded)
+		return true;
+
+	// Distinct values in the order they first show up, and their indexes
+	// sorted by value to look them up. Gives up once there are too many
+	std::vector<StringRef> distinct;
+	std::vector<unsigned short> byValue;
+	std::vector<unsigned short> codes(m_numRows);
+
+	for (unsigned int row = 0; row < m_numRows; row++)
+	{
+		StringRef cell = getCell(row, column);
+
+		unsigned int lo = 0;
+		unsigned int hi = byValue.size();
+		while (lo < hi)
+		{
+			unsigned int mid = lo + (hi - lo) / 2;
+			if (distinct[byValue[mid]] < cell)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		if (lo == byValue.size() || distinct[byValue[lo]] != cell)
+		{
+			if (distinct.size() == MAX_ENCODED_VALUES)
+				return false;
+
+			byValue.insert(byValue.begin() + lo, static_cast<unsigned short>(distinct.size()));
+			distinct.push_back(cell);
+		}
+
+		codes[row] = byValue[lo];
+	}
+
+	if (distinct.empty() || distinct.size() * MIN_REPEATS > m_numRows)
+		return false;
+
+	// The dictionary goes into the arena in sorted order, and codes are
+	// renumbered from first seen to sorted
+	std::vector<char> arena;
+	std::vector<unsigned int> offsets(1, 0);
+	std::vector<unsigned short> sortedCode(distinct.size());
+	for (unsigned int i = 0; i < byValue.size(); i++)
+	{
+		const StringRef& value = distinct[byValue[i]];
+		arena.insert(arena.end(), value.data, value.data + value.size);
+		offsets.push_back(arena.size());
+		sortedCode[byValue[i]] = static_cast<unsigned short>(i);
+	}
+
+	for (unsigned int row = 0; row < m_numRows; row++)
+		codes[row] = sortedCode[codes[row]];
+
+	col.arena.swap(arena);
+	col.offsets.swap(offsets);
+	std::vector<size_t>().swap(col.mappedBegins);
+	std::vector<unsigned int>().swap(col.mappedSizes);
+	col.numMappedRows = 0;
+	col.codes.swap(codes);
+	col.encoded = true;
+	col.dictionarySize = distinct.size();
+	col.newValues = 0;
+	syncData(col);
+	return true;
+}
+
+bool ColumnStore::isEncoded(unsigned int column) const
+{
+	return m_columns[column].encoded;
+}
+
+// Only for encoded columns. Codes run from 0 to this - 1
+unsigned int ColumnStore::getDictionarySize(unsigned int column) const
+{
+	return m_columns[column].dictionarySize;
+}
+
+StringRef ColumnStore::getDictionaryValue(unsigned int column, unsigned int code) const
+{
+	return dictionaryValue(m_columns[column], code);
+}
+
+// Must be O(log D). Number of dictionary values < value (<= value if
+// inclusive), so the codes of [min, max] are countCodesBelow(min, false) to
+// countCodesBelow(max, true) - 1
+unsigned int ColumnStore::countCodesBelow(unsigned int column, const StringRef& value,
+	bool inclusive) const
+{
+	return findCode(m_columns[column], value, inclusive);
+}
+
+// Writes every column: whether it is encoded, its entries (the dictionary,
+// or every row's text) as an offset array and their bytes, then its codes
+// and parsed values if it has them
+void ColumnStore::saveSnapshot(SnapshotWriter& out) const
+{
+	for (unsigned int c = 0; c < m_columns.size(); c++)
+	{
+		const Column& col = m_columns[c];
+		unsigned int numEntries = col.encoded ? col.dictionarySize : m_numRows;
+		out.writeU32(col.encoded ? 1 : 0);
+		out.writeU32(numEntries);
+
+		out.align();
+		unsigned int offset = 0;
+		out.writeU32(offset);
+		for (unsigned int e = 0; e < numEntries; e++)
+		{
+			offset += (col.encoded ? dictionaryValue(col, e) : getCell(e, c)).size;
+			out.writeU32(offset);
+		}
+
+		out.align();
+		for (unsigned int e = 0; e < numEntries; e++)
+		{
+			StringRef entry = col.encoded ? dictionaryValue(col, e) : getCell(e, c);
+			out.write(entry.data, entry.size);
+		}
+
+		if (col.encoded)
+		{
+			out.align();
+			out.write(col.codeData, m_numRows * sizeof(unsigned short));
+		}
+
+		if (col.type != TypedValue::vt_string)
+		{
+			out.align();
+			out.write(col.valueData, m_numRows * sizeof(long long));
+		}
+	}
+}
+
+// Must be O(N). Reads the columns saveSnapshot wrote, for numRows rows, in
+// place: nothing is copied until a row is appended, so in must stay valid
+// until then. Columns must already be reset with their types. Every offset
+// and code is checked once here, so a corrupt file is refused instead of
+// read out of bounds later
+bool ColumnStore::openSnapshot(SnapshotReader& in, unsigned int numRows)
+{
+	for (unsigned int c = 0; c < m_columns.size(); c++)
+	{
+		Column& col = m_columns[c];
+
+		unsigned int encoded;
+		unsigned int numEntries;
+		if (!in.readU32(encoded) || !in.readU32(numEntries) ||
+			(encoded ? numEntries > MAX_DICTIONARY_SIZE : numEntries != numRows))
+			return false;
+
+		const unsigned int *offsets = static_cast<const unsigned int*>(
+			in.readArray(static_cast<size_t>(numEntries) + 1, sizeof(unsigned int)));
+		if (offsets == nullptr || !SnapshotReader::validOffsets(offsets, numEntries))
+			return false;
+
+		in.align();
+		const char *bytes = in.readBytes(offsets[numEntries]);
+		const unsigned short *codes = static_cast<const unsigned short*>(
+			encoded ? in.readArray(numRows, sizeof(unsigned short)) : nullptr);
+		const void *values = col.type != TypedValue::vt_string ?
+			in.readArray(numRows, sizeof(long long)) : nullptr;
+		if (bytes == nullptr || (encoded && codes == nullptr) ||
+			(col.type != TypedValue::vt_string && values == nullptr))
+			return false;
+
+		for (unsigned int row = 0; encoded && row < numRows; row++)
+		{
+			if (codes[row] >= numEntries)
+				return false;
+		}
+
+		col.arenaData = bytes;
+		col.offsetData = offsets;
+		col.codeData = codes;
+		col.valueData = static_cast<const long long*>(values);
+		col.encoded = encoded != 0;
+		col.dictionarySize = col.encoded ? numEntries : 0;
+		col.newValues = 0;
+		col.external = true;
+	}
+
+	m_numRows = numRows;
+	m_external = true;
+	return true;
+}
+
+/////////////////////
+/* PRIVATE METHODS */
+/////////////////////
+
+// Stores one cell of a row that isn't mapped: its bytes go into the arena,
+// or for encoded columns just its code. A value an encoded column hasn't
+// seen costs a pass over every row, so after a few of those the column is
+// decoded once instead
+void ColumnStore::appendCell(Column& col, const StringRef& cell)
+{
+	if (col.encoded)
+	{
+		unsigned int code = findCode(col, cell, false);
+		bool known = code < col.dictionarySize && dictionaryValue(col, code) == cell;
+
+		if (known || (col.newValues < MAX_NEW_VALUES && col.dictionarySize < MAX_DICTIONARY_SIZE))
+		{
+			if (!known)
+			{
+				addToDictionary(col, cell, code);
+				col.newValues++;
+			}
+
+			col.codes.push_back(static_cast<unsigned short>(code));
+			appendValue(col, cell);
+			syncData(col);
+			return;
+		}
+
+		decodeColumn(col);
+	}
+
+	col.arena.insert(col.arena.end(), cell.data, cell.data + cell.size);
+	col.offsets.push_back(col.arena.size());
+	appendValue(col, cell);
+	syncData(col);
+}
+
+
+// Parses a cell of a typed column once, as it is stored
+void ColumnStore::appendValue(Column& col, const StringRef& cell)
+{
+	if (col.type == TypedValue::vt_string)
+		return;
+
+	long long value;
+	if (!TypedValue::parse(col.type, cell, value))
+		value = TypedValue::NULL_VALUE;
+	col.values.push_back(value);
+}
+
+// Number of dictionary values < value (<= value if inclusive)
+unsigned int ColumnStore::findCode(const Column& col, const StringRef& value, bool inclusive)
+{
+	unsigned int lo = 0;
+	unsigned int hi = col.dictionarySize;
+	while (lo < hi)
+	{
+		unsigned int mid = lo + (hi - lo) / 2;
+		int cmp = dictionaryValue(col, mid).compare(value);
+		if (cmp < 0 || (inclusive && cmp == 0))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+StringRef ColumnStore::dictionaryValue(const Column& col, unsigned int code)
+{
+	unsigned int begin = col.offsetData[code];
+	return StringRef(col.arenaData + begin, col.offsetData[code + 1] - begin);
+}
+
+// Inserts value into the dictionary as code, moving every later value (and
+// the codes of the rows holding them) up by one. O(N), but a column is only
+// encoded when its values repeat, so new ones are rare
+void ColumnStore::addToDictionary(Column& col, const StringRef& value, unsigned int code)
+{
+	unsigned int at = col.offsets[code];
+	col.arena.insert(col.arena.begin() + at, value.data, value.data + value.size);
+	col.offsets.insert(col.offsets.begin() + code + 1, at);
+	for (unsigned int k = code + 1; k < col.offsets.size(); k++)
+		col.offsets[k] += value.size;
+
+	for (unsigned int row = 0; row < col.codes.size(); row++)
+		col.codes[row] += col.codes[row] >= code;
+
+	col.dictionarySize++;
+	syncData(col);
+}
+
+// Goes back to keeping every row's text, all of them in the arena
+void ColumnStore::decodeColumn(Column& col)
+{
+	std::vector<char> arena;
+	std::vector<unsigned int> offsets(1, 0);
+	offsets.reserve(col.codes.size() + 1);
+	for (unsigned int row = 0; row < col.codes.size(); row++)
+	{
+		StringRef value = dictionaryValue(col, col.codes[row]);
+		arena.insert(arena.end(), value.data, value.data + value.size);
+		offsets.push_back(arena.size());
+	}
+
+	col.arena.swap(arena);
+	col.offsets.swap(offsets);
+	std::vector<unsigned short>().swap(col.codes);
+	col.encoded = false;
+	col.dictionarySize = 0;
+	syncData(col);
+}
+
+void ColumnStore::syncData(Column& col)
+{
+	col.arenaData = col.arena.data();
+	col.offsetData = col.offsets.data();
+	col.codeData = col.codes.data();
+	col.valueData = col.values.data();
+}
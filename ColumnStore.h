@@ -0,0 +1,161 @@
+#ifndef COLUMNSTORE_H
+#define COLUMNSTORE_H
+
+#include <string>
+#include <vector>
+#include "StringRef.h"
+#include "TypedValue.h"
+#include "Snapshot.h"
+
+// Row storage for Database, laid out by column. Each schema field gets one
+// character arena holding all of its values back to back plus an offset
+// array, so a cell costs 4 bytes of bookkeeping instead of a std::string
+// and a heap allocation, and scanning one field reads memory in order.
+//
+// Rows can also live in an external buffer (a memory mapped file). Those
+// "mapped" rows are only recorded as offsets into the buffer, must all be
+// appended before any arena row, and are only valid while the buffer is.
+//
+// Typed columns (see TypedValue) also keep every cell parsed into a long
+// long when the row is appended, so comparisons never look at the text.
+//
+// Columns that only hold a handful of distinct values can be dictionary
+// encoded (encodeColumn): the arena then holds each distinct value once, in
+// sorted order, and every row is stored as a 2 byte code, the position of
+// its value in the arena. Codes order like the values they stand for, so
+// comparing two codes is comparing the two strings.
+//
+// The columns of an opened snapshot are read straight out of the snapshot's
+// memory until the next row is appended, which copies them in first.
+class ColumnStore
+{
+public:
+	ColumnStore();
+	void reset(unsigned int numColumns);
+	void swap(ColumnStore& other);
+	unsigned int getNumColumns() const;
+	unsigned int getNumRows() const;
+	void setColumnType(unsigned int column, TypedValue::Type type);
+	TypedValue::Type getColumnType(unsigned int column) const;
+	void appendRow(const std::vector<std::string>& row);
+	void appendRow(const StringRef *row);
+	void attachMapping(const char *base);
+	bool appendMappedRow(const StringRef *row);
+	void getRow(unsigned int rowNum, std::vector<std::string>& row) const;
+	void scanValues(unsigned int column, long long min, long long max, std::vector<int>& rows) const;
+	void scanCells(unsigned int column, const StringRef *min, const StringRef *max,
+		std::vector<int>& rows) const;
+	void copyExternalColumns();
+	bool encodeColumn(unsigned int column);  // needs copyExternalColumns first
+	bool isEncoded(unsigned int column) const;
+	unsigned int getDictionarySize(unsigned int column) const;
+	StringRef getDictionaryValue(unsigned int column, unsigned int code) const;
+	unsigned int countCodesBelow(unsigned int column, const StringRef& value, bool inclusive) const;
+	void scanCodes(unsigned int column, unsigned int min, unsigned int max, std::vector<int>& rows) const;
+	void saveSnapshot(SnapshotWriter& out) const;
+	bool openSnapshot(SnapshotReader& in, unsigned int numRows);
+
+	// Must be O(1). A view of an arena or encoded row is invalidated by the
+	// next appendRow
+	StringRef getCell(unsigned int rowNum, unsigned int column) const
+	{
+		const Column& col = m_columns[column];
+		if (col.encoded)
+			rowNum = col.codeData[rowNum];
+		else if (rowNum < col.numMappedRows)
+			return StringRef(m_mappedBase + col.mappedBegins[rowNum], col.mappedSizes[rowNum]);
+		else
+			rowNum -= col.numMappedRows;
+
+		unsigned int begin = col.offsetData[rowNum];
+		return StringRef(col.arenaData + begin, col.offsetData[rowNum + 1] - begin);
+	}
+
+	// Must be O(1). Only for encoded columns
+	unsigned int getCode(unsigned int rowNum, unsigned int column) const
+	{
+		return m_columns[column].codeData[rowNum];
+	}
+
+	// Must be O(1). Only for typed columns, TypedValue::NULL_VALUE if the
+	// cell didn't parse
+	long long getValue(unsigned int rowNum, unsigned int column) const
+	{
+		return m_columns[column].valueData[rowNum];
+	}
+
+private:
+	// Prevents ColumnStores from being copied or assigned
+	ColumnStore(const ColumnStore& other);
+	ColumnStore& operator=(const ColumnStore& rhs);
+
+	// Most distinct values a column is encoded with, and how many times each
+	// has to be used on average for encoding it to pay off
+	static const unsigned int MAX_ENCODED_VALUES = 256;
+	static const unsigned int MIN_REPEATS = 16;
+	// Encoded columns that outgrow this (through appended rows) go back to
+	// storing every row's text
+	static const unsigned int MAX_DICTIONARY_SIZE = 4096;
+	// So do ones that get more new values than this since they were encoded
+	// or opened: each new value renumbers the code of every row
+	static const unsigned int MAX_NEW_VALUES = 16;
+
+	struct Column
+	{
+		Column()
+		{
+			type = TypedValue::vt_string;
+			offsets.push_back(0);
+			numMappedRows = 0;
+			encoded = false;
+			dictionarySize = 0;
+			newValues = 0;
+			external = false;
+			syncData(*this);
+		}
+		TypedValue::Type type;
+		std::vector<char> arena;
+		// Value of arena row i is arena[offsets[i], offsets[i + 1]), so there
+		// is always one more offset than there are arena rows. Encoded
+		// columns keep their dictionary here instead, one entry per code
+		std::vector<unsigned int> offsets;
+		// Mapped rows: value of row i starts mappedBegins[i] bytes into the buffer
+		std::vector<size_t> mappedBegins;
+		std::vector<unsigned int> mappedSizes;
+		unsigned int numMappedRows;  // rows before the first arena row
+		// Parsed value of every row (arena and mapped), empty for vt_string
+		std::vector<long long> values;
+		// Dictionary code of every row, only used while encoded
+		bool encoded;
+		std::vector<unsigned short> codes;
+		unsigned int dictionarySize;
+		unsigned int newValues;  // added to the dictionary by appended rows
+		// Every read goes through these: the data of the vectors above, or
+		// while external the arrays of an opened snapshot (the vectors are
+		// empty then). A copied Column has to be synced again
+		const char *arenaData;
+		const unsigned int *offsetData;
+		const unsigned short *codeData;
+		const long long *valueData;
+		bool external;
+	};
+
+	// Private methods
+	static void appendCell(Column& col, const StringRef& cell);
+	static void appendValue(Column& col, const StringRef& cell);
+	static unsigned int findCode(const Column& col, const StringRef& value, bool inclusive);
+	static StringRef dictionaryValue(const Column& col, unsigned int code);
+	static void addToDictionary(Column& col, const StringRef& value, unsigned int code);
+	static void decodeColumn(Column& col);
+	static void syncData(Column& col);
+
+	// Private data members
+	std::vector<Column> m_columns;
+	const char *m_mappedBase;
+	unsigned int m_numMappedRows;
+	unsigned int m_numRows;
+	bool m_external;  // some column is still read from a snapshot
+
+};
+
+#endif  // COLUMNSTORE_H
@@ -1,21 +1,40 @@
 #include "Database.h"
+#include <cstring>  // for memchr, memcmp
+#include <algorithm>  // for sort
+#include <climits>  // for LLONG_MAX
 
 // Must be O(1)
 Database::Database()
 {
 	m_validDb = true;
-	m_numberOfLines = 0;
+	m_schemaSize = 0;
+	m_defaultIndexEngine = ie_multiMap;
+	m_sortMethod = sm_merge;
+	m_parallelSearch = false;
+	m_schemaVersion = 0;
+	m_threadPool = nullptr;
+	setNumThreads(std::thread::hardware_concurrency());
 }
 
 Database::~Database()
 {
-	for (unsigned int i = 0; i < m_schemaSize; i++)
+	delete m_threadPool;
+
+	for (unsigned int i = 0; i < m_fieldIndex.size(); i++)
 		delete m_fieldIndex[i];
 
 	m_fieldIndex.clear();
 }
 
 bool Database::specifySchema(const std::vector<FieldDescriptor>& schema)
+{
+	SharedMutex::WriteLock lock(m_lock);
+
+	return setSchema(schema);
+}
+
+// specifySchema for callers that already hold m_lock (the loads)
+bool Database::setSchema(const std::vector<FieldDescriptor>& schema)
 {
 	// First check for existing schema. Reset, if one exists
 	if (!m_schema.empty())
@@ -37,47 +56,144 @@ bool Database::specifySchema(const std::vector<FieldDescriptor>& schema)
 
 	// TODO: Optional checks to implement: empty and duplicate name values
 
-	// Initialize m_fieldIndex vector based on indexed fields
-	m_fieldIndex.resize(schema.size());
+	// Drop the indexes of a previous schema
+	for (unsigned int i = 0; i < m_fieldIndex.size(); i++)
+		delete m_fieldIndex[i];
+
+	// Initialize m_fieldIndex vector based on indexed fields. Fields without
+	// an index are searched by scanning their column, so they get none
+	m_fieldIndex.assign(schema.size(), nullptr);
 
 	// Initialize private data member for schema size
 	m_schemaSize = schema.size();
 
 	for (unsigned int i = 0; i < m_schemaSize; i++)
-		m_fieldIndex[i] = new MultiMap;
+		if (schema[i].index == it_indexed)
+			m_fieldIndex[i] = new FieldIndex(static_cast<FieldIndex::Engine>(schema[i].engine));
+
+	// One column per field in the row store, typed fields parsed as they load
+	m_columns.reset(m_schemaSize);
+	for (unsigned int i = 0; i < m_schemaSize; i++)
+		m_columns.setColumnType(i, static_cast<TypedValue::Type>(schema[i].type));
 
 	m_schema = schema;
+	m_schemaVersion++;
+	m_resultCache.clear();
 	return true;
 }
 
+void Database::setDefaultIndexEngine(IndexEngine engine)
+{
+	SharedMutex::WriteLock lock(m_lock);
+
+	m_defaultIndexEngine = engine;
+}
+
+// The calling thread always takes part in the work, so the pool only needs
+// numThreads - 1 workers of its own
+void Database::setNumThreads(unsigned int numThreads)
+{
+	SharedMutex::WriteLock lock(m_lock);
+
+	delete m_threadPool;
+	m_threadPool = nullptr;
+
+	if (numThreads > 1)
+		m_threadPool = new ThreadPool(numThreads - 1);
+}
+
+void Database::setSortMethod(SortMethod method)
+{
+	SharedMutex::WriteLock lock(m_lock);
+
+	m_sortMethod = method;
+}
+
+void Database::setParallelSearch(bool parallel)
+{
+	SharedMutex::WriteLock lock(m_lock);
+
+	m_parallelSearch = parallel;
+}
+
+// Searches that come back are answered from the cache until a row they
+// match is added or the database is reloaded. A search with a limit only
+// caches the rows up to the end of its page, so later pages past that miss.
+// Counts roughly 4 bytes per cached row number, plus each search's criteria
+void Database::setResultCacheBudget(size_t bytes)
+{
+	SharedMutex::WriteLock lock(m_lock);
+
+	m_resultCache.setBudget(bytes);
+}
+
 bool Database::addRow(const std::vector<std::string>& rowOfData)
 {
-	// Check for existing schema and valid db. If none, return false;
-	if (m_schema.empty() || !validDb())
-		return false;
+	SharedMutex::WriteLock lock(m_lock);
 
-	// Check for mismatching row and schema vector sizes
-	if (m_schema.size() != rowOfData.size())
+	// With a log open the row is logged before it is stored, so every row
+	// the database holds can be replayed. storeRow's checks come first so
+	// that a row it would refuse never reaches the log. Once the log has
+	// failed, rows are refused until openLog succeeds again
+	if (m_log.failed())
 		return false;
 
-	m_rows.push_back(rowOfData);
-	
-	// Divy up values of row into fieldIndex
-	for (unsigned int i = 0; i < rowOfData.size(); i++)
+	if (m_log.isOpen())
 	{
-		if (m_schema[i].index == it_indexed)
-		{
-			// "m_rows.size() - 1" will always be the row number of the most
-			// recently added row (rowOfData) to the m_rows vector 
-			m_fieldIndex[i]->insert(rowOfData[i], m_rows.size() - 1);
-		}
+		if (m_schema.empty() || !validDb() || m_schema.size() != rowOfData.size() ||
+			!m_log.append(rowOfData))
+			return false;
 	}
+
+	if (!storeRow(rowOfData))
+		return false;
+	
+	// Divy up values of row into fieldIndex
+	// "m_columns.getNumRows() - 1" will always be the row number of the most
+	// recently added row (rowOfData) to the column store
+	insertIntoFieldIndex(m_columns.getNumRows() - 1);
+	invalidateCachedResults(m_columns.getNumRows() - 1);
 	
 	return true;
 }
 
+// Adds every row already in the log (rows added on top of whatever was
+// loaded before the log was last open, so load that first), then logs every
+// row addRow adds from now on. The log is flushed to the disk every
+// rowsPerSync rows; see WriteAheadLog
+bool Database::openLog(std::string filename, unsigned int rowsPerSync)
+{
+	SharedMutex::WriteLock lock(m_lock);
+
+	return m_log.open(filename, rowsPerSync, [this](const std::vector<std::string>& row)
+	{
+		if (!storeRow(row))
+			return false;
+
+		insertIntoFieldIndex(m_columns.getNumRows() - 1);
+		invalidateCachedResults(m_columns.getNumRows() - 1);
+		return true;
+	});
+}
+
+bool Database::syncLog()
+{
+	SharedMutex::WriteLock lock(m_lock);
+
+	return m_log.sync();
+}
+
+void Database::closeLog()
+{
+	SharedMutex::WriteLock lock(m_lock);
+
+	m_log.close();
+}
+
 bool Database::loadFromURL(std::string url)
 {
+	SharedMutex::WriteLock lock(m_lock);
+
 	// Clear temp storage variable
 	m_loadPageData = "";
 
@@ -93,11 +209,40 @@ bool Database::loadFromURL(std::string url)
 
 bool Database::loadFromFile(std::string filename)
 {
+	SharedMutex::WriteLock lock(m_lock);
+
 	std::ifstream infile(filename);
 
 	if (!infile)
 		return false;
 
+	// Parallel loading needs the whole file in memory to split it up
+	else if (m_threadPool != nullptr)
+	{
+		std::string contents;
+		infile.seekg(0, std::ios::end);
+		contents.resize(static_cast<size_t>(infile.tellg()));
+		infile.seekg(0, std::ios::beg);
+		infile.read(&contents[0], contents.size());
+
+		// Text mode may turn \r\n into \n, so fewer bytes can come back
+		contents.resize(static_cast<size_t>(infile.gcount()));
+
+		const char *begin = contents.data();
+		const char *end = begin + contents.size();
+		const char *lineEnd = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+		if (lineEnd == nullptr)
+			lineEnd = end;
+
+		// Tokenize the first line to initialize the schema
+		tokenizeFirstLine(std::string(begin, lineEnd));
+
+		if (lineEnd < end)
+			loadRowsParallel(lineEnd + 1, end, false);
+
+		return true;
+	}
+
 	else
 	{
 		// Tokenize the first line to initialize the schema
@@ -108,414 +253,1635 @@ bool Database::loadFromFile(std::string filename)
 		while (std::getline(infile, line))
 		{
 			// For input from URL equivalent see tokenizeFirstLineFromEntire()
-			m_numberOfLines++;
 			tokenizeLineIntoVector(line);
 		}
 		//std::cerr << m_loadPageData << std::endl;
 
+		encodeColumns();
+		buildFieldIndexes(0);
 		return true;
 	}
 }
 
-int Database::getNumRows() const
+// Same result as loadFromFile (\r\n line endings included, both tokenizers
+// drop the \r), but the file is memory mapped for the lifetime of the
+// Database and every field value is kept as a view into the mapping, so
+// loading costs one pass over the bytes and no per value copies
+bool Database::loadFromMappedFile(std::string filename)
 {
-	return m_numberOfLines;
-}
+	SharedMutex::WriteLock lock(m_lock);
 
-bool Database::getRow(int rowNum, std::vector<std::string>& row) const
-{
-	if (0 <= rowNum && rowNum < m_rows.size())
+	MappedFile mapping;
+	if (!mapping.open(filename, MappedFile::ap_sequential))
+		return false;
+
+	const char *end = mapping.data() + mapping.size();
+	const char *lineBegin = mapping.data();
+	const char *lineEnd = static_cast<const char*>(std::memchr(lineBegin, '\n', end - lineBegin));
+	if (lineEnd == nullptr)
+		lineEnd = end;
+
+	// Tokenize the first line to initialize the schema (this also empties the
+	// column store, so nothing still points into a previous mapping)
+	if (!tokenizeFirstLine(std::string(lineBegin, lineEnd)))
+		return false;
+
+	// Keep the mapping alive for as long as the rows point into it
+	m_mappedFile.swap(mapping);
+	m_columns.attachMapping(m_mappedFile.data());
+
+	if (m_threadPool != nullptr)
+		return lineEnd == end || loadRowsParallel(lineEnd + 1, end, true);
+
+	std::vector<StringRef> row;
+	while (lineEnd < end && lineEnd + 1 < end)
 	{
-		row = m_rows[rowNum];
-		return true;
+		lineBegin = lineEnd + 1;
+		lineEnd = static_cast<const char*>(std::memchr(lineBegin, '\n', end - lineBegin));
+		if (lineEnd == nullptr)
+			lineEnd = end;
+
+		// Equivalent to the std::getline loop in loadFromFile()
+		tokenizeLineInPlace(lineBegin, lineEnd, row);
+		storeMappedRow(row);
 	}
 
-	return false;
+	encodeColumns();
+	buildFieldIndexes(0);
+	return true;
 }
 
-int Database::search(const std::vector<SearchCriterion>& searchCriteria,
-	const std::vector<SortCriterion>& sortCriteria,
-	std::vector<int>& results)
+// Snapshot layout: a header (magic, version, a marker to catch files from
+// a machine of the other byte order, the field and row counts), the schema,
+// then ColumnStore::saveSnapshot and every index's FieldIndex::saveSnapshot
+static const char SNAPSHOT_MAGIC[8] = { 'C', 'S', '3', '2', 'S', 'N', 'A', 'P' };
+static const unsigned int SNAPSHOT_VERSION = 1;
+static const unsigned int SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+// Writes the rows, the dictionaries and the built indexes, so openSnapshot
+// can bring the database back without parsing or indexing anything
+bool Database::saveSnapshot(std::string filename) const
 {
-	// Clear out anything in results
-	results.clear();
+	SharedMutex::ReadLock lock(m_lock);
 
-	// Check for empty SearchCriterion
-	if (searchCriteria.size() == 0)
-		return ERROR_RESULT;
+	if (m_schema.empty())
+		return false;
 
-	// Check for mismatched field names and no min/max values
-	for (unsigned int i = 0; i < searchCriteria.size(); i++)
+	std::ofstream outfile(filename, std::ios::binary);
+	if (!outfile)
+		return false;
+
+	SnapshotWriter out(outfile);
+	out.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+	out.writeU32(SNAPSHOT_VERSION);
+	out.writeU32(SNAPSHOT_BYTE_ORDER);
+	out.writeU32(m_schemaSize);
+	out.writeU32(m_columns.getNumRows());
+
+	for (unsigned int i = 0; i < m_schemaSize; i++)
 	{
-		if (searchCriteria[i].minValue.empty() && searchCriteria[i].maxValue.empty())
-			return ERROR_RESULT;
-		
-		unsigned int p = 0;
-		bool fieldNameMatch;
+		out.writeU32(m_schema[i].name.size());
+		out.write(m_schema[i].name.data(), m_schema[i].name.size());
+		out.writeU32(m_schema[i].index);
+		out.writeU32(m_schema[i].engine);
+		out.writeU32(m_schema[i].type);
+	}
 
-		do
-		{
-			fieldNameMatch = false;
-			if (searchCriteria[i].fieldName == m_schema[p].name)
-			{
-				// searchCriteria will always be in order starting from 0
-				m_searchSchemaMap.push_back(p);
+	m_columns.saveSnapshot(out);
 
-				fieldNameMatch = true;
+	for (unsigned int i = 0; i < m_schemaSize; i++)
+		if (m_fieldIndex[i] != nullptr)
+			m_fieldIndex[i]->saveSnapshot(out);
 
-				break;
-			}
-			p++;
-		} 
-		while (p < m_schemaSize);
+	return out.good();
+}
 
-		if (fieldNameMatch == false)
-			return ERROR_RESULT;
+// Must be O(number of fields). The file is memory mapped and the rows and
+// indexes are used straight from it, so opening reads only the schema.
+// Adding rows afterwards copies the columns and rebuilds each index in its
+// own engine first (once)
+bool Database::openSnapshot(std::string filename)
+{
+	SharedMutex::WriteLock lock(m_lock);
+
+	MappedFile mapping;
+	if (!mapping.open(filename, MappedFile::ap_random))
+		return false;
+
+	SnapshotReader in(mapping.data(), mapping.data() + mapping.size());
+	const char *magic = in.readBytes(sizeof(SNAPSHOT_MAGIC));
+	unsigned int version, byteOrder, numFields, numRows;
+	if (magic == nullptr || std::memcmp(magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+		!in.readU32(version) || version != SNAPSHOT_VERSION ||
+		!in.readU32(byteOrder) || byteOrder != SNAPSHOT_BYTE_ORDER ||
+		!in.readU32(numFields) || !in.readU32(numRows))
+		return false;
+
+	std::vector<FieldDescriptor> schema;
+	bool anyIndexed = false;
+	for (unsigned int i = 0; i < numFields; i++)
+	{
+		unsigned int nameSize, index, engine, type;
+		const char *name;
+		if (!in.readU32(nameSize) || (name = in.readBytes(nameSize)) == nullptr ||
+			!in.readU32(index) || index > it_indexed ||
+			!in.readU32(engine) || engine > ie_bPlusTree ||
+			!in.readU32(type) || type > ft_date)
+			return false;
+
+		FieldDescriptor field;
+		field.name.assign(name, nameSize);
+		field.index = static_cast<IndexType>(index);
+		field.engine = static_cast<IndexEngine>(engine);
+		field.type = static_cast<FieldType>(type);
+		schema.push_back(field);
+		anyIndexed = anyIndexed || field.index == it_indexed;
 	}
 
-	// Organize sort criteria into a key to be used by the sorting method (similar to m_searchSchemaMap)
-	// Can't use the previous loop because searchCriteria and sortCriteria can have different sizes
-	for (unsigned int k = 0; k < sortCriteria.size(); k++)
+	// Same check setSchema makes, done before anything is replaced
+	if (!anyIndexed)
+		return false;
+
+	// Read the whole file into a column store and indexes of its own first,
+	// so one that turns out to be bad leaves the database as it was
+	ColumnStore columns;
+	columns.reset(numFields);
+	for (unsigned int i = 0; i < numFields; i++)
+		columns.setColumnType(i, static_cast<TypedValue::Type>(schema[i].type));
+
+	std::vector<FieldIndex*> fieldIndex(numFields, nullptr);
+	bool opened = columns.openSnapshot(in, numRows);
+	for (unsigned int i = 0; opened && i < numFields; i++)
 	{
-		for (unsigned int p = 0; p < m_schemaSize; p++)
+		if (schema[i].index == it_indexed)
 		{
-			if (sortCriteria[k].fieldName == m_schema[p].name)
-				m_sortSchemaMap.push_back(p);
+			fieldIndex[i] = new FieldIndex(static_cast<FieldIndex::Engine>(schema[i].engine));
+			opened = fieldIndex[i]->openSnapshot(in, numRows);
 		}
 	}
-	// Sort criteria may not be provided and the search function should still work
-
-	// If we make it here, then that means all the SearchCriterion are valid
-	// Now get all the matches and return the vector of results
-	if (!getSearchCriteriaMatches(searchCriteria, results))
-		return 0;  // Since no mathces found if returned false
 
-	// Sort
-	std::string sortMethod;
-	while (sortMethod != "m")
+	// Nothing can fail from here on. setSchema empties the column store
+	// first, so nothing still points into the previous mapping once it is
+	// released along with the local one
+	if (opened)
 	{
-		std::cout << "Please enter a sorting method:\n[m]merge sort " << std::endl;
-		std::getline(std::cin, sortMethod);
-		if (sortMethod != "m")
-			std::cout << "You did not enter [m]" << std::endl;
+		setSchema(schema);
+		m_columns.swap(columns);
+		m_fieldIndex.swap(fieldIndex);
+		m_mappedFile.swap(mapping);
 	}
 
-	// Since sortCriteria is a const parameter we need to make a copy
-	std::vector<SortCriterion> sortCritCopy = sortCriteria;
-	int resultsSize = results.size();
-	mergeSort(sortCritCopy, results, resultsSize);
+	// Either setSchema's empty indexes or the ones read from a bad file
+	for (unsigned int i = 0; i < fieldIndex.size(); i++)
+		delete fieldIndex[i];
 
-	return results.size();
+	return opened;
 }
 
-/////////////////////
-/* PRIVATE METHODS */
-/////////////////////
-
-bool Database::validDb() const
+int Database::getNumRows() const
 {
-	return m_validDb;
+	SharedMutex::ReadLock lock(m_lock);
+
+	return m_columns.getNumRows();
 }
 
-// Both input from URL and File will pass through here
-bool Database::tokenizeFirstLine(std::string firstLine)
+bool Database::getRow(int rowNum, std::vector<std::string>& row) const
 {
-	std::string delimiters = ",";
-	Tokenizer t(firstLine, delimiters);
-	std::string word;
-	std::string indexedWord;
-	std::vector<FieldDescriptor> schema;
-	FieldDescriptor tempFd;
+	SharedMutex::ReadLock lock(m_lock);
 
-	while (t.getNextToken(word))
+	if (0 <= rowNum && rowNum < (int)m_columns.getNumRows())
 	{
-		if (word[word.length() - 1] == '*')
-		{
-			// Check for empty space otherwise undefined behavior
-			if (word.length() - 1 == 0)
-				return false;
-
-			word.resize(word.length() - 1);
-			tempFd.name = word;
-			tempFd.index = it_indexed;
-			schema.push_back(tempFd);
-		}
-
-		else
-		{
-			tempFd.name = word;
-			tempFd.index = it_none;
-			schema.push_back(tempFd);
-		}
+		m_columns.getRow(rowNum, row);
+		return true;
 	}
 
-	return specifySchema(schema);
-
+	return false;
 }
 
-// Only input from URL will pass through here
-bool Database::tokenizeFirstLineFromEntire(const std::string& entireText)
+bool Database::getRowView(int rowNum, RowView& row) const
 {
-	std::istringstream s(m_loadPageData);
-	std::string line;
-	if (std::getline(s, line))
+	SharedMutex::ReadLock lock(m_lock);
+
+	if (0 <= rowNum && rowNum < (int)m_columns.getNumRows())
 	{
-		tokenizeFirstLine(line);
-		while (std::getline(s, line))
-		{
-			// Equivalent to usage in loadFromFile()
-			m_numberOfLines++;
-			tokenizeLineIntoVector(line);
-		}
+		row = RowView(m_columns, rowNum);
 		return true;
 	}
-	else
-		return false;
+
+	return false;
 }
 
-// Both input from URL and File pass through here
-void Database::tokenizeLineIntoVector(const std::string& singleLine)
+// Must be O(1). cell points into the database, see RowView for how long it lasts
+bool Database::getCell(int rowNum, unsigned int fieldNum, StringRef& cell) const
 {
-	std::string delimiters = ",";
-	Tokenizer t(singleLine, delimiters);
-	std::string word;
-	std::vector<std::string> row;
-
-	while (t.getNextToken(word))
-		row.push_back(word);
+	SharedMutex::ReadLock lock(m_lock);
 
-	addRow(row);
-
-	// minus 1 because line counter is pre-incremented
-	insertIntoFieldIndex(row, m_numberOfLines - 1);
-}
+	if (0 <= rowNum && rowNum < (int)m_columns.getNumRows() && fieldNum < m_columns.getNumColumns())
+	{
+		cell = m_columns.getCell(rowNum, fieldNum);
+		return true;
+	}
 
-void Database::insertIntoFieldIndex(const std::vector<std::string>& row, int rowNum)
-{
-	// Iterating through only a single row at a time
-	for (unsigned int i = 0; i < m_schemaSize; i++)
-		if (m_schema[i].index == it_indexed)
-			m_fieldIndex[i]->insert(row[i], rowNum);
+	return false;
 }
 
-bool Database::getSearchCriteriaMatches(const std::vector<SearchCriterion>& searchCriteria,
-	std::vector<int>& results)
+int Database::search(const std::vector<SearchCriterion>& searchCriteria,
+	const std::vector<SortCriterion>& sortCriteria,
+	std::vector<int>& results, unsigned int limit, unsigned int offset) const
 {
-	// Must be O(M log N), M matched iterms and N rows
-	std::unordered_set<int> first;
-	std::unordered_set<int> second;
+	SharedMutex::ReadLock lock(m_lock);
 
-	// Each time an additional search criterion after the first is added
-	// check the new values against the previous and put the union of values
-	// into a new temp unordered set. Once done iterating through this second
-	// set, assign over the values from the second back to the first. Continue this
-	// loop checking any additional search criterion against the previous amalgamation
-	// Must be O(CM log N) C number of search criteria, M matched items and N rows
-	for (unsigned int i = 0; i < searchCriteria.size(); i++)
-	{
-		// This gets the corresponding field index 
-		int tempFieldIndexSub = m_searchSchemaMap[i];
-
-		std::string minVal = searchCriteria[i].minValue;
-		std::string maxVal = searchCriteria[i].maxValue;
+	// Clear out anything in results of the previous search
+	results.clear();
 
-		MultiMap::Iterator it; 
+	std::vector<Range> ranges;
+	if (!makeRanges(searchCriteria, ranges))
+		return ERROR_RESULT;
 
-		// There are 3 possible cases: 
-		// (A) both min and max are provided (iterate from min towards max)
-		// (B) min is provided but max is NOT provided (same, iterate from min towards max which is an invalid state)
-		// (C) min is NOT provided but max is provided (start iterating from max backwards towards min which is the invalid state) 
+	SortKeys sortKeys;
+	resolveSortKeys(sortCriteria, sortKeys);
 
-		if (minVal != "")  // Case (A) and (B)
-			it = m_fieldIndex[tempFieldIndexSub]->findEqualOrSuccessor(minVal);
+	return searchRanges(ranges, sortKeys, results, limit, offset);
+}
 
-		else if (minVal == "" && maxVal != "")  // Case (C)
-			it = m_fieldIndex[tempFieldIndexSub]->findEqualOrPredecessor(maxVal);
+// Resolves the field names and checks the bounds once, so running query
+// skips straight to the search
+bool Database::prepare(const std::vector<SearchCriterion>& searchCriteria,
+	const std::vector<SortCriterion>& sortCriteria, Query& query) const
+{
+	SharedMutex::ReadLock lock(m_lock);
 
-		if (!it.valid())  //  This likely implies a MultiMap that has very few or 0 actual items
-			return false;
+	query = Query();
+	if (searchCriteria.empty())
+		return false;
 
-		else
+	for (unsigned int i = 0; i < searchCriteria.size(); i++)
+	{
+		unsigned int field;
+		if (!findField(searchCriteria[i].fieldName, field) ||
+			!validBounds(m_schema[field].type, searchCriteria[i].minValue, searchCriteria[i].maxValue))
 		{
-			// If either no min or max value provided, this loop will terminate in accordance after getting the
-			// greatest possible min or max value
-			while (it.valid()) 
-			{
-				// Case (A)
-				if (minVal != "" &&  maxVal != "" && it.getKey() > maxVal)
-					break;
-
-				// Only on the first iteration
-				if (i == 0)
-					first.insert(it.getValue());
-
-				else
-				{
-					// unordered set "count", 1 indicates match is also in the prior unordered set (first)
-					if (first.count(it.getValue()) == 1)
-						second.insert(it.getValue());
-				}
-
-				// Case (A) and (B)
-				if (minVal != "")
-					it.next();
-
-				// Case (C)
-				else
-					it.prev();
-			}
-
-			// Assign over the union between the two back to first only after the first iteration
-			if (i > 0)
-			{
-				first = second;
-				second.clear();
-			}
+			query = Query();
+			return false;
 		}
-	}
 
-	// Copy the row numbers into the results vector and return
-	// using c++11 range-based for loop
-	for (unsigned int x : first)
-		results.push_back(x);
+		query.m_criteria.push_back(searchCriteria[i]);
+		query.m_fields.push_back(field);
+		query.m_types.push_back(m_schema[field].type);
+	}
 
+	resolveSortKeys(sortCriteria, query.m_sortKeys);
+	query.m_db = this;
+	query.m_schemaVersion = m_schemaVersion;
 	return true;
 }
 
-void Database::mergeSort(std::vector<SortCriterion>& sortCriteria,
-	std::vector<int>& results, int size)
+// Same as the search the query was prepared from, with its current bounds.
+// Fails if the query was prepared by another Database or the schema
+// changed since prepare
+int Database::search(const Query& query, std::vector<int>& results,
+	unsigned int limit, unsigned int offset) const
 {
-	if (size == 1)
-		return;
-
-	// Recursively call the first half of results
-	mergeSort(sortCriteria, results, size / 2);
+	SharedMutex::ReadLock lock(m_lock);
 
-	// Create a vector for the second half of results values
-	std::vector<int> secHalf;
-	for (int i = size / 2; i < size; i++)
-		secHalf.push_back(results[i]);
+	results.clear();
+	if (query.m_db != this || query.m_criteria.empty() || query.m_schemaVersion != m_schemaVersion)
+		return ERROR_RESULT;
 
-	// Recursively call the second half of results (secHalf vector)
-	mergeSort(sortCriteria, secHalf, size - (size / 2));
+	for (unsigned int i = 0; i < query.m_fields.size(); i++)
+	{
+		if (query.m_fields[i] >= m_schemaSize)
+			return ERROR_RESULT;
+	}
 
-	// Put the results of secHalf back into results
-	for (int g = size / 2, j = 0; g < size; g++, j++)
-		results[g] = secHalf[j];
+	for (unsigned int k = 0; k < query.m_sortKeys.size(); k++)
+	{
+		if (query.m_sortKeys[k].first >= m_schemaSize)
+			return ERROR_RESULT;
+	}
 
-	// Call merge to merge everything together in O(log N)
-	merge(sortCriteria, results, size / 2, size - (size / 2));
+	// Ranges of encoded columns depend on the dictionaries, which can
+	// change with every added row, so they are made fresh every time
+	std::vector<Range> ranges(query.m_criteria.size());
+	for (unsigned int i = 0; i < ranges.size(); i++)
+		makeRange(query.m_criteria[i], query.m_fields[i], ranges[i]);
 
+	return searchRanges(ranges, query.m_sortKeys, results, limit, offset);
 }
 
-void Database::merge(std::vector<SortCriterion>& sortCriteria, 
-	std::vector<int>& results, int n1, int n2)
+// The rest of search, once the criteria are turned into ranges
+int Database::searchRanges(const std::vector<Range>& ranges, const SortKeys& sortKeys,
+	std::vector<int>& results, unsigned int limit, unsigned int offset) const
 {
-	int i, j, k;
-	i = j = k = 0;
-
-	std::vector<int> temp;
-
-	// Initialize a vector that holds the sec half
-	std::vector<int> sec;
-	for (int a = n1; a < results.size(); a++)
-		sec.push_back(results[a]);
-	
-	while (i < n1 || j < n2)
+	RowComparator comparator(m_columns);
+	for (unsigned int k = 0; k < sortKeys.size(); k++)
+		comparator.addKey(sortKeys[k].first, sortKeys[k].second);
+
+	// The cache has the first rows of the order, enough for the page if
+	// they reach past it (or are every match)
+	std::string key;
+	if (m_resultCache.enabled())
 	{
-		std::string tempVal;
-		std::string secTempVal;
-
-		if (i < n1)
+		key = cacheKey(ranges, sortKeys);
+		unsigned int numCached;
+		ResultCache<std::vector<Range> >::Results cached = m_resultCache.find(key, numCached);
+		if (cached && (cached->size() == numCached ||
+			cached->size() >= static_cast<unsigned long long>(offset) + limit))
 		{
-			// A temp string value corresponding to the first value of the sort criteria
-			tempVal = m_rows[results[i]][m_sortSchemaMap[k]];
+			unsigned int pageStart = std::min<size_t>(offset, cached->size());
+			unsigned int pageEnd = cached->size() - pageStart > limit ? pageStart + limit : cached->size();
+			results.assign(cached->begin() + pageStart, cached->begin() + pageEnd);
+			return numCached;
 		}
+	}
 
-		if (j < n2)
-		{
-			// Another temp string value but for the second half of results
-			secTempVal = m_rows[sec[j]][m_sortSchemaMap[k]];
-		}
+	// If we make it here, then that means all the SearchCriterion are valid
+	// Now get all the matches (none leaves results empty)
+	getSearchCriteriaMatches(ranges, results);
 
-		// No more values from the first half
-		if (i == n1)
-		{
-			temp.push_back(sec[j++]);
-		}
+	int numMatches = results.size();
 
-		// No more values from the second half
-		else if (j == n2)
-		{
-			temp.push_back(results[i++]);
-		}
+	// Only the first offset + limit rows of the order matter, so with a limit
+	// those are picked out instead of sorting every match
+	unsigned int pageStart = std::min<size_t>(offset, results.size());
+	unsigned int pageEnd = results.size() - pageStart > limit ? pageStart + limit : results.size();
+	unsigned int numSorted = comparator.empty() ? results.size() : 0;
 
-		// Same as the values represnted by results[i] < sec[j]
-		else if (tempVal < secTempVal)
-		{
-			temp.push_back(results[i++]);
-		}
+	// Sort, using whichever method setSortMethod picked
+	if (!comparator.empty() && pageStart < pageEnd)
+	{
+		if (pageEnd < results.size())
+			selectTopResults(comparator, results, pageEnd);
+		else
+			sortResults(comparator, results);
+		numSorted = results.size();
+	}
 
-		// If the values are equal
-		// TODO FIX BUG HERE: With more than 1 sort criteria, some items are out of order or duplicated
-		else if (tempVal == secTempVal)
+	if (!key.empty())
+	{
+		// Kept with text bounds: codes would go stale as dictionaries grow
+		std::vector<Range> textRanges(ranges);
+		size_t rangeBytes = textRanges.capacity() * sizeof(Range);
+		for (unsigned int i = 0; i < textRanges.size(); i++)
 		{
-			for (k = 0; k < m_sortSchemaMap.size(); k++)
-			{
-				if (sortCriteria[k].ordering == ot_ascending)
-				{
-					if (m_rows[results[i]][m_sortSchemaMap[k]] < m_rows[sec[j]][m_sortSchemaMap[k]])
-					{
-						temp.push_back(results[i++]);
-						break;
-					}
-					
-					else if (m_rows[results[i]][m_sortSchemaMap[k]] > m_rows[sec[j]][m_sortSchemaMap[k]])
-					{
-						temp.push_back(results[j++]);
-						break;
-					}
-
-					// If all values by sort map are equal
-					else if (k == m_sortSchemaMap.size() - 1 &&
-						m_rows[results[i]][m_sortSchemaMap[k]] == m_rows[sec[j]][m_sortSchemaMap[k]])
-					{
-						temp.push_back(results[i++]);
-						break;
-					}
-				}
-
-				else if (sortCriteria[k].ordering == ot_descending)
-				{
-					if (m_rows[results[i]][m_sortSchemaMap[k]] < m_rows[sec[j]][m_sortSchemaMap[k]])
-					{
-						temp.push_back(sec[j++]);
-						break;
-					}
-
-					else if (m_rows[results[i]][m_sortSchemaMap[k]] > m_rows[sec[j]][m_sortSchemaMap[k]])
-					{
-						temp.push_back(sec[i++]);
-						break;
-					}
-
-					else if (k == m_sortSchemaMap.size() - 1 &&
-						m_rows[results[i]][m_sortSchemaMap[k]] == m_rows[sec[j]][m_sortSchemaMap[k]])
-					{
-						temp.push_back(results[i++]);
-						break;
-					}
-				}
-			}
-			k = 0;  // Reset k because not all values start off initially equal}
+			textRanges[i].byCode = false;
+			rangeBytes += textRanges[i].minKey.capacity() + textRanges[i].maxKey.capacity();
 		}
 
-		else
-			temp.push_back(sec[j++]);
+		m_resultCache.insert(key, textRanges, rangeBytes, std::make_shared<std::vector<int> >(
+			results.begin(), results.begin() + numSorted), numMatches);
 	}
 
-	for (int z = 0; z < (n1 + n2); z++)
-		results[z] = temp[z];
+	results.resize(pageEnd);
+	results.erase(results.begin(), results.begin() + pageStart);
+
+	return numMatches;
+}
+
+// Same criteria as search. Without sort criteria the cursor walks the most
+// selective index range (or the column of a field without one) as it goes,
+// checking the other criteria row by row, so rows come out in that index's
+// key order (row order for a column) and nothing is held in memory. Sorting
+// has to see every match first, so sorted cursors walk a sorted result
+bool Database::openCursor(const std::vector<SearchCriterion>& searchCriteria,
+	const std::vector<SortCriterion>& sortCriteria, Cursor& cursor) const
+{
+	SharedMutex::ReadLock lock(m_lock);
+
+	cursor = Cursor();
+	cursor.m_db = this;
+
+	if (!makeRanges(searchCriteria, cursor.m_ranges))
+		return false;
+
+	const std::vector<Range>& ranges = cursor.m_ranges;
+
+	SortKeys sortKeys;
+	resolveSortKeys(sortCriteria, sortKeys);
+
+	RowComparator comparator(m_columns);
+	for (unsigned int k = 0; k < sortKeys.size(); k++)
+		comparator.addKey(sortKeys[k].first, sortKeys[k].second);
+
+	if (!comparator.empty())
+	{
+		if (getSearchCriteriaMatches(cursor.m_ranges, cursor.m_results))
+			sortResults(comparator, cursor.m_results);
+
+		cursor.m_source = Cursor::cs_results;
+	}
+
+	else
+	{
+		unsigned int driverSize = 0;
+		cursor.m_driver = ranges.size();
+		for (unsigned int i = 0; i < ranges.size(); i++)
+		{
+			if (m_schema[ranges[i].field].index != it_indexed)
+				continue;
+
+			unsigned int size = countRange(ranges[i]);
+			if (cursor.m_driver == ranges.size() || size < driverSize)
+			{
+				cursor.m_driver = i;
+				driverSize = size;
+			}
+		}
+
+		if (cursor.m_driver < ranges.size())
+		{
+			cursor.m_source = Cursor::cs_index;
+			cursor.m_it = rangeStart(ranges[cursor.m_driver]);
+		}
+		else
+			cursor.m_source = Cursor::cs_column;
+	}
+
+	cursor.seek();
+	return true;
+}
+
+Database::Cursor::Cursor()
+{
+	m_db = nullptr;
+	m_source = cs_none;
+	m_driver = 0;
+	m_position = 0;
+	m_row = -1;
+}
+
+bool Database::Cursor::valid() const
+{
+	return m_row >= 0;
+}
+
+int Database::Cursor::getRow() const
+{
+	return m_row;
+}
+
+bool Database::Cursor::next()
+{
+	if (!valid())
+		return false;
+
+	if (m_source == cs_index)
+	{
+		if (!m_ranges[m_driver].minKey.empty())
+			m_it.next();
+		else
+			m_it.prev();
+	}
+	else
+		m_position++;
+
+	seek();
+	return valid();
+}
+
+// Stops at the first match from the current position on, or at the end
+void Database::Cursor::seek()
+{
+	m_row = -1;
+
+	if (m_source == cs_results)
+	{
+		if (m_position < m_results.size())
+			m_row = m_results[m_position];
+		return;
+	}
+
+	if (m_source == cs_index)
+	{
+		const Range& driver = m_ranges[m_driver];
+		while (m_it.valid())
+		{
+			if (!driver.minKey.empty() && !driver.maxKey.empty() && m_it.getKey() > driver.maxKey)
+				return;
+
+			if (matchesOthers(m_it.getValue()))
+			{
+				m_row = m_it.getValue();
+				return;
+			}
+
+			if (!driver.minKey.empty())
+				m_it.next();
+			else
+				m_it.prev();
+		}
+		return;
+	}
+
+	if (m_source == cs_column)
+	{
+		for (unsigned int numRows = m_db->m_columns.getNumRows(); m_position < numRows; m_position++)
+		{
+			if (matchesOthers(m_position))
+			{
+				m_row = m_position;
+				return;
+			}
+		}
+	}
+}
+
+// Every range but the one being walked (all of them when scanning a column)
+bool Database::Cursor::matchesOthers(unsigned int rowNum) const
+{
+	for (unsigned int i = 0; i < m_ranges.size(); i++)
+	{
+		if ((m_source != cs_index || i != m_driver) && !m_db->rowInRange(rowNum, m_ranges[i]))
+			return false;
+	}
+	return true;
+}
+
+/////////////////////
+/* PRIVATE METHODS */
+/////////////////////
+
+Database::Query::Query()
+{
+	m_db = nullptr;
+	m_schemaVersion = 0;
+}
+
+unsigned int Database::Query::size() const
+{
+	return m_criteria.size();
+}
+
+// New bounds for the criterion-th search criterion, checked the way prepare
+// checked the first ones. Leaves the old bounds if they don't fit the field
+bool Database::Query::setBounds(unsigned int criterion, const std::string& minValue,
+	const std::string& maxValue)
+{
+	if (criterion >= m_criteria.size() || !validBounds(m_types[criterion], minValue, maxValue))
+		return false;
+
+	m_criteria[criterion].minValue = minValue;
+	m_criteria[criterion].maxValue = maxValue;
+	return true;
+}
+
+bool Database::validDb() const
+{
+	return m_validDb;
+}
+
+// "Name:type" in a header line. Fields without a type are strings
+static bool parseFieldType(std::string& word, Database::FieldType& type)
+{
+	type = Database::ft_string;
+
+	std::string::size_type colon = word.rfind(':');
+	if (colon == std::string::npos)
+		return true;
+
+	std::string typeName = word.substr(colon + 1);
+	word.resize(colon);
+
+	if (typeName == "int" || typeName == "integer")
+		type = Database::ft_integer;
+	else if (typeName == "decimal")
+		type = Database::ft_decimal;
+	else if (typeName == "date")
+		type = Database::ft_date;
+	else if (typeName != "string")
+		return false;
+
+	return true;
+}
+
+// Both input from URL and File will pass through here
+bool Database::tokenizeFirstLine(std::string firstLine)
+{
+	// Drop the \r of a \r\n line ending the loaders left in place
+	if (!firstLine.empty() && firstLine[firstLine.length() - 1] == '\r')
+		firstLine.resize(firstLine.length() - 1);
+
+	std::string delimiters = ",";
+	Tokenizer t(firstLine, delimiters);
+	std::string word;
+	std::string indexedWord;
+	std::vector<FieldDescriptor> schema;
+	FieldDescriptor tempFd;
+
+	while (t.getNextToken(word))
+	{
+		if (word[word.length() - 1] == '*')
+		{
+			// Check for empty space otherwise undefined behavior
+			if (word.length() - 1 == 0)
+				return false;
+
+			word.resize(word.length() - 1);
+			if (!parseFieldType(word, tempFd.type) || word.empty())
+				return false;
+
+			tempFd.name = word;
+			tempFd.index = it_indexed;
+			tempFd.engine = m_defaultIndexEngine;
+			schema.push_back(tempFd);
+		}
+
+		else
+		{
+			if (!parseFieldType(word, tempFd.type) || word.empty())
+				return false;
+
+			tempFd.name = word;
+			tempFd.index = it_none;
+			schema.push_back(tempFd);
+		}
+	}
+
+	return setSchema(schema);
+
+}
+
+// Only input from URL will pass through here
+bool Database::tokenizeFirstLineFromEntire(const std::string& entireText)
+{
+	if (m_threadPool != nullptr)
+	{
+		const char *begin = m_loadPageData.data();
+		const char *end = begin + m_loadPageData.size();
+		const char *lineEnd = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+		if (lineEnd == nullptr)
+			lineEnd = end;
+
+		if (begin == end || !tokenizeFirstLine(std::string(begin, lineEnd)))
+			return false;
+
+		return lineEnd == end || loadRowsParallel(lineEnd + 1, end, false);
+	}
+
+	std::istringstream s(m_loadPageData);
+	std::string line;
+	if (std::getline(s, line))
+	{
+		tokenizeFirstLine(line);
+		while (std::getline(s, line))
+		{
+			// Equivalent to usage in loadFromFile()
+			tokenizeLineIntoVector(line);
+		}
+
+		encodeColumns();
+		buildFieldIndexes(0);
+		return true;
+	}
+	else
+		return false;
+}
+
+// Both input from URL and File pass through here
+void Database::tokenizeLineIntoVector(const std::string& singleLine)
+{
+	// Binary mode reads and URL bodies keep the \r of a \r\n line ending;
+	// dropped the same way tokenizeLineInPlace drops it
+	size_t length = singleLine.length();
+	if (length > 0 && singleLine[length - 1] == '\r')
+		length--;
+
+	std::string delimiters = ",";
+	Tokenizer t(singleLine.substr(0, length), delimiters);
+	std::string word;
+	std::vector<std::string> row;
+
+	while (t.getNextToken(word))
+		row.push_back(word);
+
+	// The field indexes are built in one go once every row is stored
+	storeRow(row);
+}
+
+// Splits a line exactly like Tokenizer would with "," as the delimiter,
+// but the tokens are views into the line instead of copies
+void Database::tokenizeLineInPlace(const char *begin, const char *end,
+	std::vector<StringRef>& row) const
+{
+	row.clear();
+
+	// Lines of a mapped file still carry the \r of a \r\n line ending, which
+	// a text mode std::getline would have dropped
+	if (end > begin && *(end - 1) == '\r')
+		end--;
+
+	const char *pos = begin;
+	while (pos < end)
+	{
+		const char *delim = static_cast<const char*>(std::memchr(pos, ',', end - pos));
+		if (delim == nullptr)
+			delim = end;
+
+		row.push_back(StringRef(pos, delim - pos));
+
+		// Runs of delimiters are skipped, same as Tokenizer::getNextToken
+		pos = delim;
+		while (pos < end && *pos == ',')
+			pos++;
+	}
+}
+
+// Appends a row to the column store without touching the field indexes
+bool Database::storeRow(const std::vector<std::string>& rowOfData)
+{
+	// Check for existing schema and valid db. If none, return false;
+	if (m_schema.empty() || !validDb())
+		return false;
+
+	// Check for mismatching row and schema vector sizes
+	if (m_schema.size() != rowOfData.size())
+		return false;
+
+	m_columns.appendRow(rowOfData);
+	return true;
+}
+
+// Mapped file counterpart of storeRow
+bool Database::storeMappedRow(const std::vector<StringRef>& row)
+{
+	if (m_schema.empty() || !validDb())
+		return false;
+
+	if (m_schema.size() != row.size())
+		return false;
+
+	return m_columns.appendMappedRow(&row[0]);
+}
+
+// Key a row is indexed under: the text of a string field, or the encoded
+// parsed value of a typed one (written to keyBuffer, KEY_SIZE bytes)
+StringRef Database::indexKey(unsigned int rowNum, unsigned int field, char *keyBuffer) const
+{
+	if (m_schema[field].type == ft_string)
+		return m_columns.getCell(rowNum, field);
+
+	TypedValue::encodeKey(m_columns.getValue(rowNum, field), keyBuffer);
+	return StringRef(keyBuffer, TypedValue::KEY_SIZE);
+}
+
+// Keys are read back out of the column store, so this works the same for
+// arena and mapped rows
+void Database::insertIntoFieldIndex(int rowNum)
+{
+	char keyBuffer[TypedValue::KEY_SIZE];
+
+	// Iterating through only a single row at a time
+	for (unsigned int i = 0; i < m_schemaSize; i++)
+		if (m_schema[i].index == it_indexed)
+			m_fieldIndex[i]->insert(indexKey(rowNum, i, keyBuffer), rowNum);
+}
+
+// Parallel counterpart of the line by line loaders. Every line after the
+// header in [begin, end) becomes a row, in file order:
+//  1. the text is cut into one chunk per thread at newline boundaries
+//  2. the chunks are tokenized concurrently into views
+//  3. rows are appended to the column store chunk by chunk, so row numbers
+//     come out the same as with the single threaded loader
+//  4. each indexed field's index is built by its own task, since the indexes
+//     share nothing with each other
+// With mapped set the views are kept as mapped rows instead of being copied.
+bool Database::loadRowsParallel(const char *begin, const char *end, bool mapped)
+{
+	if (m_schema.empty() || !validDb())
+		return false;
+
+	unsigned int numChunks = m_threadPool->getNumWorkers() + 1;
+
+	std::vector<const char*> bounds;
+	bounds.push_back(begin);
+	for (unsigned int c = 1; c < numChunks; c++)
+	{
+		const char *cut = begin + (end - begin) / numChunks * c;
+		if (cut < bounds.back())
+			cut = bounds.back();
+
+		const char *newline = static_cast<const char*>(std::memchr(cut, '\n', end - cut));
+		bounds.push_back(newline == nullptr ? end : newline + 1);
+	}
+	bounds.push_back(end);
+
+	// Tokens of every well formed line in a chunk, m_schemaSize at a time
+	std::vector<std::vector<StringRef> > chunkCells(numChunks);
+
+	m_threadPool->parallelFor(numChunks, [&](unsigned int c)
+	{
+		std::vector<StringRef> row;
+		const char *lineBegin = bounds[c];
+		while (lineBegin < bounds[c + 1])
+		{
+			const char *lineEnd = static_cast<const char*>(
+				std::memchr(lineBegin, '\n', bounds[c + 1] - lineBegin));
+			if (lineEnd == nullptr)
+				lineEnd = bounds[c + 1];
+
+			tokenizeLineInPlace(lineBegin, lineEnd, row);
+
+			// Same check addRow does for mismatching row and schema sizes
+			if (row.size() == m_schemaSize)
+				chunkCells[c].insert(chunkCells[c].end(), row.begin(), row.end());
+
+			lineBegin = lineEnd + 1;
+		}
+	});
+
+	unsigned int firstNewRow = m_columns.getNumRows();
+	for (unsigned int c = 0; c < numChunks; c++)
+	{
+		for (unsigned int r = 0; r < chunkCells[c].size(); r += m_schemaSize)
+		{
+			if (mapped)
+				m_columns.appendMappedRow(&chunkCells[c][r]);
+			else
+				m_columns.appendRow(&chunkCells[c][r]);
+		}
+
+		std::vector<StringRef>().swap(chunkCells[c]);
+	}
+
+	encodeColumns();
+	buildFieldIndexes(firstNewRow);
+	return true;
+}
+
+// Orders (key, row) pairs the way a field index iterates them
+static bool keyThenRowLess(const std::pair<StringRef, unsigned int>& lhs,
+	const std::pair<StringRef, unsigned int>& rhs)
+{
+	int cmp = lhs.first.compare(rhs.first);
+	if (cmp != 0)
+		return cmp < 0;
+	return lhs.second < rhs.second;
+}
+
+// First 8 bytes of a key as a big endian integer (zero padded), so comparing
+// two prefixes as integers orders them the same way as the keys
+static unsigned long long keyPrefix(const StringRef& key)
+{
+	unsigned long long prefix = 0;
+	for (unsigned int i = 0; i < 8; i++)
+	{
+		prefix <<= 8;
+		if (i < key.size)
+			prefix |= static_cast<unsigned char>(key.data[i]);
+	}
+	return prefix;
+}
+
+// Sorts (key, row) pairs by key, then row. Pairs arrive in row order, so a
+// stable LSD radix sort on the 8 byte key prefixes orders almost everything
+// without touching the key bytes again; only runs that share a prefix but
+// hold different keys (longer than 8 bytes) still need comparing
+static void sortKeyRowPairs(std::vector<std::pair<StringRef, unsigned int> >& pairs)
+{
+	struct Record
+	{
+		unsigned long long prefix;
+		unsigned int index;  // position in pairs
+	};
+
+	unsigned int n = pairs.size();
+	std::vector<Record> records(n), scratch(n);
+	for (unsigned int i = 0; i < n; i++)
+	{
+		records[i].prefix = keyPrefix(pairs[i].first);
+		records[i].index = i;
+	}
+
+	for (unsigned int shift = 0; shift < 64 && n > 1; shift += 8)
+	{
+		unsigned int counts[256] = { 0 };
+		for (unsigned int i = 0; i < n; i++)
+			counts[(records[i].prefix >> shift) & 0xff]++;
+
+		// Skip bytes that are the same in every key (the padding of short keys)
+		if (counts[(records[0].prefix >> shift) & 0xff] == n)
+			continue;
+
+		unsigned int start = 0;
+		for (unsigned int b = 0; b < 256; b++)
+		{
+			unsigned int count = counts[b];
+			counts[b] = start;
+			start += count;
+		}
+
+		for (unsigned int i = 0; i < n; i++)
+			scratch[counts[(records[i].prefix >> shift) & 0xff]++] = records[i];
+		records.swap(scratch);
+	}
+
+	std::vector<std::pair<StringRef, unsigned int> > sorted(n);
+	for (unsigned int i = 0; i < n; i++)
+		sorted[i] = pairs[records[i].index];
+
+	for (unsigned int i = 0; i < n;)
+	{
+		unsigned int j = i + 1;
+		bool sameKeys = true;
+		for (; j < n && records[j].prefix == records[i].prefix; j++)
+		{
+			if (sorted[j].first != sorted[i].first)
+				sameKeys = false;
+		}
+
+		if (!sameKeys)
+			std::sort(sorted.begin() + i, sorted.begin() + j, keyThenRowLess);
+		i = j;
+	}
+
+	pairs.swap(sorted);
+}
+
+// Dictionary encodes every column with few enough distinct values (see
+// ColumnStore), one column per thread
+void Database::encodeColumns()
+{
+	m_columns.copyExternalColumns();
+
+	std::function<void(unsigned int)> encodeOne = [&](unsigned int column)
+	{
+		m_columns.encodeColumn(column);
+	};
+
+	if (m_threadPool != nullptr)
+		m_threadPool->parallelFor(m_columns.getNumColumns(), encodeOne);
+	else
+	{
+		for (unsigned int column = 0; column < m_columns.getNumColumns(); column++)
+			encodeOne(column);
+	}
+}
+
+// Indexes rows [firstRow, getNumRows()) of every indexed field after a load.
+// A load always starts from empty indexes, so rather than descending the
+// tree once per row, each field sorts its (key, row) pairs once and has the
+// index built bottom up from the sorted run in O(N). The indexes share
+// nothing, so each field is built by its own task when running threaded
+void Database::buildFieldIndexes(unsigned int firstRow)
+{
+	if (m_schema.empty() || !validDb())
+		return;
+
+	std::vector<unsigned int> indexedFields;
+	for (unsigned int i = 0; i < m_schemaSize; i++)
+	{
+		if (m_schema[i].index == it_indexed)
+			indexedFields.push_back(i);
+	}
+
+	unsigned int numRows = m_columns.getNumRows();
+	std::function<void(unsigned int)> buildOne = [&](unsigned int f)
+	{
+		unsigned int field = indexedFields[f];
+
+		if (firstRow == 0 && m_schema[field].type == ft_string && m_columns.isEncoded(field))
+		{
+			// Codes order like the values, so a counting sort on them puts the
+			// rows in index order without comparing a single key
+			std::vector<unsigned int> starts(m_columns.getDictionarySize(field) + 1, 0);
+			for (unsigned int row = 0; row < numRows; row++)
+				starts[m_columns.getCode(row, field) + 1]++;
+			for (unsigned int code = 1; code < starts.size(); code++)
+				starts[code] += starts[code - 1];
+
+			std::vector<std::pair<StringRef, unsigned int> > pairs(numRows);
+			for (unsigned int row = 0; row < numRows; row++)
+			{
+				unsigned int code = m_columns.getCode(row, field);
+				pairs[starts[code]++] = std::make_pair(m_columns.getDictionaryValue(field, code), row);
+			}
+
+			m_fieldIndex[field]->bulkLoad(pairs);
+		}
+
+		else if (firstRow == 0)
+		{
+			// Encoded keys of a typed field only have to live until bulkLoad
+			// has copied them
+			std::vector<char> keyBytes;
+			if (m_schema[field].type != ft_string)
+				keyBytes.resize(static_cast<size_t>(numRows) * TypedValue::KEY_SIZE);
+
+			std::vector<std::pair<StringRef, unsigned int> > pairs(numRows);
+			for (unsigned int row = 0; row < numRows; row++)
+				pairs[row] = std::make_pair(indexKey(row, field,
+					keyBytes.empty() ? nullptr : &keyBytes[static_cast<size_t>(row) * TypedValue::KEY_SIZE]), row);
+
+			sortKeyRowPairs(pairs);
+			m_fieldIndex[field]->bulkLoad(pairs);
+		}
+
+		else
+		{
+			char keyBuffer[TypedValue::KEY_SIZE];
+			for (unsigned int row = firstRow; row < numRows; row++)
+				m_fieldIndex[field]->insert(indexKey(row, field, keyBuffer), row);
+		}
+	};
+
+	if (m_threadPool != nullptr)
+		m_threadPool->parallelFor(indexedFields.size(), buildOne);
+	else
+	{
+		for (unsigned int f = 0; f < indexedFields.size(); f++)
+			buildOne(f);
+	}
+}
+
+// Resolves every criterion against the schema. False if one names a field
+// that doesn't exist, gives no bounds, or gives a typed field a bound that
+// doesn't parse as its type
+bool Database::makeRanges(const std::vector<SearchCriterion>& searchCriteria,
+	std::vector<Range>& ranges) const
+{
+	// Check for empty SearchCriterion
+	if (searchCriteria.size() == 0)
+		return false;
+
+	ranges.resize(searchCriteria.size());
+
+	// Check for mismatched field names and no min/max values
+	for (unsigned int i = 0; i < searchCriteria.size(); i++)
+	{
+		unsigned int p;
+		if (!findField(searchCriteria[i].fieldName, p) ||
+			!validBounds(m_schema[p].type, searchCriteria[i].minValue, searchCriteria[i].maxValue))
+			return false;
+
+		makeRange(searchCriteria[i], p, ranges[i]);
+	}
+
+	return true;
+}
+
+// Organize sort criteria into a comparator to be used by the sorting method.
+// Later criteria only break ties left by earlier ones. Sort criteria may not
+// be provided and the search function should still work
+// Unknown sort fields are skipped
+void Database::resolveSortKeys(const std::vector<SortCriterion>& sortCriteria,
+	SortKeys& sortKeys) const
+{
+	for (unsigned int k = 0; k < sortCriteria.size(); k++)
+	{
+		unsigned int p;
+		if (findField(sortCriteria[k].fieldName, p))
+			sortKeys.push_back(std::make_pair(p, sortCriteria[k].ordering == ot_descending));
+	}
+}
+
+// Same key for every search with the same results: the criteria are put in
+// field order, and typed bounds are already in their parsed form (so "030"
+// and "30" are the same Age). Every part is length prefixed. The sort method
+// is part of it too, since introsort may order equal rows differently from
+// the stable sorts
+std::string Database::cacheKey(const std::vector<Range>& ranges, const SortKeys& sortKeys) const
+{
+	std::vector<std::string> parts;
+	for (unsigned int i = 0; i < ranges.size(); i++)
+	{
+		std::string part;
+		appendKeyPart(part, ranges[i].field);
+		appendKeyPart(part, ranges[i].minKey.size());
+		part += ranges[i].minKey;
+		appendKeyPart(part, ranges[i].maxKey.size());
+		part += ranges[i].maxKey;
+		parts.push_back(part);
+	}
+	std::sort(parts.begin(), parts.end());
+
+	std::string key;
+	appendKeyPart(key, m_sortMethod);
+	appendKeyPart(key, parts.size());
+	for (unsigned int i = 0; i < parts.size(); i++)
+		key += parts[i];
+
+	for (unsigned int k = 0; k < sortKeys.size(); k++)
+		appendKeyPart(key, sortKeys[k].first * 2 + (sortKeys[k].second ? 1 : 0));
+
+	return key;
+}
+
+void Database::appendKeyPart(std::string& key, unsigned int number)
+{
+	key.append(reinterpret_cast<const char*>(&number), sizeof(number));
+}
+
+// A new row only changes the results of the searches it matches
+void Database::invalidateCachedResults(unsigned int rowNum)
+{
+	m_resultCache.removeIf([&](const std::vector<Range>& ranges)
+	{
+		for (unsigned int i = 0; i < ranges.size(); i++)
+		{
+			if (!rowInRange(rowNum, ranges[i]))
+				return false;
+		}
+		return true;
+	});
+}
+
+bool Database::findField(const std::string& name, unsigned int& field) const
+{
+	for (field = 0; field < m_schemaSize; field++)
+	{
+		if (m_schema[field].name == name)
+			return true;
+	}
+	return false;
+}
+
+// At least one bound has to be given, and bounds on a typed field have to
+// parse as that type
+bool Database::validBounds(FieldType type, const std::string& minValue,
+	const std::string& maxValue)
+{
+	if (minValue.empty() && maxValue.empty())
+		return false;
+
+	TypedValue::Type valueType = static_cast<TypedValue::Type>(type);
+	long long value;
+	return valueType == TypedValue::vt_string ||
+		((minValue.empty() || TypedValue::parse(valueType, minValue, value)) &&
+		(maxValue.empty() || TypedValue::parse(valueType, maxValue, value)));
+}
+
+// Plans the search around its most selective criterion. Each criterion is a
+// range of one field, and the indexes know how big each indexed range is:
+//  1. the smallest indexed range is walked to get the candidate rows
+//  2. ranges much smaller than the candidates are walked too and ANDed in as
+//     row bitmaps, smallest first
+//  3. candidates still left are checked against the remaining (wide or not
+//     indexed) criteria directly in the column store
+// so a search costs about as much as its most selective criteria. Without
+// any indexed criterion, a column is scanned in full for the candidates
+// instead. The rows come out sorted by row number.
+bool Database::getSearchCriteriaMatches(const std::vector<Range>& ranges,
+	std::vector<int>& results) const
+{
+	// (size, criterion) of every range that can be walked, smallest first
+	std::vector<std::pair<unsigned int, unsigned int> > bySize;
+	for (unsigned int i = 0; i < ranges.size(); i++)
+	{
+		if (m_schema[ranges[i].field].index == it_indexed)
+			bySize.push_back(std::make_pair(countRange(ranges[i]), i));
+	}
+	std::sort(bySize.begin(), bySize.end());
+
+	std::vector<bool> applied(ranges.size(), false);
+	std::vector<int> candidates;
+	bool inRowOrder = false;
+
+	if (bySize.empty())
+	{
+		// Typed columns have the fastest scan
+		unsigned int scanned = 0;
+		for (unsigned int i = 0; i < ranges.size(); i++)
+		{
+			if (m_schema[ranges[i].field].type != ft_string)
+			{
+				scanned = i;
+				break;
+			}
+		}
+
+		scanColumn(ranges[scanned], candidates);
+		applied[scanned] = true;
+		inRowOrder = true;
+	}
+
+	else
+	{
+		// Some criterion matches nothing, so the search can't either
+		if (bySize[0].first == 0)
+			return false;
+
+		// Walking an index entry costs a few times more than checking a cell,
+		// so another range is only worth walking and ANDing in while it is
+		// well below the rows still left
+		const unsigned int WALK_COST = 4;
+		RowBitmap matches;
+		bool inBitmap = false;
+
+		// With workers to spare, every range not too far above the smallest
+		// is walked at the same time as it, each into its own bitmap, so the
+		// walks cost about as much as the longest one
+		unsigned int numWalked = 1;
+		if (m_parallelSearch && m_threadPool != nullptr)
+		{
+			while (numWalked < bySize.size() &&
+				bySize[numWalked].first <= static_cast<unsigned long long>(bySize[0].first) * WALK_COST)
+				numWalked++;
+		}
+
+		if (numWalked > 1)
+		{
+			std::vector<RowBitmap> walked(numWalked);
+			m_threadPool->parallelFor(numWalked, [&](unsigned int k)
+			{
+				std::vector<int> rangeRows;
+				rangeRows.reserve(bySize[k].first);
+				scanRange(ranges[bySize[k].second], rangeRows);
+				walked[k].addRows(rangeRows);
+			});
+
+			std::swap(matches, walked[0]);
+			for (unsigned int k = 1; k < numWalked && !matches.empty(); k++)
+				matches.intersectWith(walked[k]);
+
+			for (unsigned int k = 0; k < numWalked; k++)
+				applied[bySize[k].second] = true;
+
+			if (matches.empty())
+				return false;
+
+			inBitmap = true;
+		}
+
+		else
+		{
+			candidates.reserve(bySize[0].first);
+			scanRange(ranges[bySize[0].second], candidates);
+			applied[bySize[0].second] = true;
+		}
+
+		for (unsigned int k = numWalked; k < bySize.size(); k++)
+		{
+			if (bySize[k].first * WALK_COST > (inBitmap ? matches.cardinality() : candidates.size()))
+				break;
+
+			if (!inBitmap)
+			{
+				matches.addRows(candidates);
+				inBitmap = true;
+			}
+
+			std::vector<int> rangeRows;
+			scanRange(ranges[bySize[k].second], rangeRows);
+
+			RowBitmap rangeBitmap;
+			rangeBitmap.addRows(rangeRows);
+			matches.intersectWith(rangeBitmap);
+			applied[bySize[k].second] = true;
+
+			if (matches.empty())
+				return false;
+		}
+
+		if (inBitmap)
+		{
+			candidates.clear();
+			matches.toVector(candidates);
+			inRowOrder = true;
+		}
+	}
+
+	for (unsigned int c = 0; c < candidates.size(); c++)
+	{
+		bool match = true;
+		for (unsigned int i = 0; i < ranges.size() && match; i++)
+		{
+			if (!applied[i])
+				match = rowInRange(candidates[c], ranges[i]);
+		}
+
+		if (match)
+			results.push_back(candidates[c]);
+	}
+
+	// Rows of a single index range come out in key order, put them in row order
+	if (!inRowOrder)
+	{
+		RowBitmap ordered;
+		ordered.addRows(results);
+		results.clear();
+		ordered.toVector(results);
+	}
+
+	return !results.empty();
+}
+
+// search() has already checked the field exists and typed bounds parse
+void Database::makeRange(const SearchCriterion& criterion, unsigned int field, Range& range) const
+{
+	range.field = field;
+	range.minKey = criterion.minValue;
+	range.maxKey = criterion.maxValue;
+	range.byCode = false;
+
+	// Typed fields are indexed under encoded keys, so the bounds are encoded
+	// the same way. Cells that didn't parse are indexed under the null key,
+	// which sorts first, so a missing min becomes the smallest real value and
+	// they never match
+	TypedValue::Type type = static_cast<TypedValue::Type>(m_schema[field].type);
+	if (type != TypedValue::vt_string)
+	{
+		range.minValue = TypedValue::NULL_VALUE + 1;
+		if (!criterion.minValue.empty())
+			TypedValue::parse(type, criterion.minValue, range.minValue);
+		range.minKey = TypedValue::encodeKey(range.minValue);
+
+		range.maxValue = LLONG_MAX;
+		if (!criterion.maxValue.empty())
+		{
+			TypedValue::parse(type, criterion.maxValue, range.maxValue);
+			range.maxKey = TypedValue::encodeKey(range.maxValue);
+		}
+	}
+
+	else if (m_columns.isEncoded(field))
+	{
+		range.byCode = true;
+		range.minValue = criterion.minValue.empty() ? 0 :
+			m_columns.countCodesBelow(field, criterion.minValue, false);
+		range.maxValue = static_cast<long long>(criterion.maxValue.empty() ? m_columns.getDictionarySize(field) :
+			m_columns.countCodesBelow(field, criterion.maxValue, true)) - 1;
+	}
+}
+
+// Must be O(log N). Exact number of rows scanRange would produce
+unsigned int Database::countRange(const Range& range) const
+{
+	const FieldIndex *index = m_fieldIndex[range.field];
+
+	if (range.minKey.empty())
+		return index->countLessOrEqual(range.maxKey);
+	if (range.maxKey.empty())
+		return index->size() - index->countLess(range.minKey);
+	return index->countRange(range.minKey, range.maxKey);
+}
+
+// Where walking a range's index entries starts. There are 3 possible cases:
+// (A) both min and max are provided (iterate from min towards max)
+// (B) min is provided but max is NOT provided (same, iterate from min towards max which is an invalid state)
+// (C) min is NOT provided but max is provided (start iterating from max backwards towards min which is the invalid state)
+FieldIndex::Iterator Database::rangeStart(const Range& range) const
+{
+	if (!range.minKey.empty())  // Case (A) and (B)
+		return m_fieldIndex[range.field]->findEqualOrSuccessor(range.minKey);
+	return m_fieldIndex[range.field]->findEqualOrPredecessor(range.maxKey);  // Case (C)
+}
+
+// Walks the index entries of a range, appending their rows to rows
+void Database::scanRange(const Range& range, std::vector<int>& rows) const
+{
+	FieldIndex::Iterator it = rangeStart(range);
+
+	while (it.valid())
+	{
+		// Case (A)
+		if (!range.minKey.empty() && !range.maxKey.empty() && it.getKey() > range.maxKey)
+			break;
+
+		rows.push_back(it.getValue());
+
+		if (!range.minKey.empty())
+			it.next();
+		else
+			it.prev();
+	}
+}
+
+// Must be O(N). Every row in the range, in row order, found by reading the
+// field's column instead of its index (which fields without one don't have)
+void Database::scanColumn(const Range& range, std::vector<int>& rows) const
+{
+	if (m_schema[range.field].type != ft_string)
+	{
+		m_columns.scanValues(range.field, range.minValue, range.maxValue, rows);
+		return;
+	}
+
+	if (range.byCode)
+	{
+		if (range.minValue <= range.maxValue)
+			m_columns.scanCodes(range.field, range.minValue, range.maxValue, rows);
+		return;
+	}
+
+	StringRef min(range.minKey);
+	StringRef max(range.maxKey);
+	m_columns.scanCells(range.field, range.minKey.empty() ? nullptr : &min,
+		range.maxKey.empty() ? nullptr : &max, rows);
+}
+
+// Must be O(1). Same test as walking the range, but on the stored cell
+bool Database::rowInRange(unsigned int rowNum, const Range& range) const
+{
+	if (m_schema[range.field].type != ft_string)
+	{
+		long long value = m_columns.getValue(rowNum, range.field);
+		return range.minValue <= value && value <= range.maxValue;
+	}
+
+	if (range.byCode)
+	{
+		long long code = m_columns.getCode(rowNum, range.field);
+		return range.minValue <= code && code <= range.maxValue;
+	}
+
+	StringRef cell = m_columns.getCell(rowNum, range.field);
+	return (range.minKey.empty() || cell >= StringRef(range.minKey)) &&
+		(range.maxKey.empty() || cell <= StringRef(range.maxKey));
+}
+
+void Database::sortResults(const RowComparator& comparator, std::vector<int>& results) const
+{
+	if (results.size() < 2)
+		return;
+
+	switch (m_sortMethod)
+	{
+	case sm_introsort:
+		// Fastest, but rows that compare equal come out in no particular order
+		std::sort(results.begin(), results.end(), comparator);
+		break;
+
+	case sm_parallel:
+		parallelMergeSort(comparator, results);
+		break;
+
+	default:
+	{
+		std::vector<int> scratch(results.size());
+		mergeSort(comparator, &results[0], &results[0] + results.size(), &scratch[0]);
+		break;
+	}
+	}
+}
+
+// Keeps only the first count rows of the sorted order, sorted, in
+// O(M log count) for M results. Rows that compare equal are ordered by row
+// number, the same order the stable sorts leave them in, so pages of the
+// same query line up whatever limit and offset they were asked with
+void Database::selectTopResults(const RowComparator& comparator, std::vector<int>& results,
+	unsigned int count) const
+{
+	struct RowOrder
+	{
+		const RowComparator *comparator;
+
+		bool operator()(int lhs, int rhs) const
+		{
+			int cmp = comparator->compare(lhs, rhs);
+			return cmp < 0 || (cmp == 0 && lhs < rhs);
+		}
+	};
+
+	RowOrder order = { &comparator };
+	std::partial_sort(results.begin(), results.begin() + count, results.end(), order);
+	results.resize(count);
+}
+
+// Stable bottom up merge sort of [first, last). scratch must have room for
+// as many elements and is the only extra memory used, the runs ping pong
+// between the two buffers instead of being copied out at every level
+void Database::mergeSort(const RowComparator& comparator, int *first, int *last,
+	int *scratch) const
+{
+	const unsigned int RUN = 16;
+	unsigned int n = last - first;
+
+	// Insertion sort short runs first, merging single elements is wasteful
+	for (unsigned int runStart = 0; runStart < n; runStart += RUN)
+	{
+		unsigned int runEnd = runStart + RUN < n ? runStart + RUN : n;
+		for (unsigned int i = runStart + 1; i < runEnd; i++)
+		{
+			int row = first[i];
+			unsigned int j = i;
+			for (; j > runStart && comparator(row, first[j - 1]); j--)
+				first[j] = first[j - 1];
+			first[j] = row;
+		}
+	}
+
+	int *src = first;
+	int *dst = scratch;
+	for (unsigned int width = RUN; width < n; width *= 2)
+	{
+		for (unsigned int lo = 0; lo < n; lo += 2 * width)
+		{
+			unsigned int mid = lo + width < n ? lo + width : n;
+			unsigned int hi = lo + 2 * width < n ? lo + 2 * width : n;
+			merge(comparator, src + lo, src + mid, src + mid, src + hi, dst + lo);
+		}
+		std::swap(src, dst);
+	}
+
+	// An odd number of passes leaves the sorted rows in scratch
+	if (src != first)
+		std::copy(src, src + n, first);
+}
+
+// Merges the sorted runs [first1, last1) and [first2, last2) into out. On
+// ties the row from the first run goes first, which keeps the sort stable
+void Database::merge(const RowComparator& comparator, const int *first1, const int *last1,
+	const int *first2, const int *last2, int *out) const
+{
+	const int *i = first1;
+	const int *j = first2;
+
+	while (i < last1 && j < last2)
+	{
+		if (comparator(*j, *i))
+			*out++ = *j++;
+		else
+			*out++ = *i++;
+	}
+
+	out = std::copy(i, last1, out);
+	std::copy(j, last2, out);
+}
+
+// Must be O(log N). How many of the first k rows merge() would output come
+// from the first run, found by binary search: if the first run's next row
+// would still go before the second run's last row taken, more are needed
+unsigned int Database::coRank(const RowComparator& comparator, const int *first1,
+	unsigned int size1, const int *first2, unsigned int size2, unsigned int k) const
+{
+	unsigned int lo = k > size2 ? k - size2 : 0;
+	unsigned int hi = k < size1 ? k : size1;
+
+	while (lo < hi)
+	{
+		unsigned int i = lo + (hi - lo) / 2;
+		unsigned int j = k - i;
+		if (j > 0 && !comparator(first2[j - 1], first1[i]))
+			lo = i + 1;
+		else
+			hi = i;
+	}
+	return lo;
+}
+
+// Each thread merge sorts one slice, then neighbouring slices are merged
+// pairwise until one run is left. Every round keeps all the threads busy:
+// each merge is cut into pieces of its output, and coRank finds where each
+// piece starts in both runs, so the pieces merge independently (and the
+// last rounds aren't left to one or two threads)
+void Database::parallelMergeSort(const RowComparator& comparator, std::vector<int>& results) const
+{
+	std::vector<int> scratch(results.size());
+
+	unsigned int numSlices = m_threadPool == nullptr ? 1 : m_threadPool->getNumWorkers() + 1;
+	if (results.size() < 4096 * numSlices)
+		numSlices = 1;
+
+	std::vector<unsigned int> bounds;
+	for (unsigned int s = 0; s <= numSlices; s++)
+		bounds.push_back(static_cast<unsigned int>(
+			static_cast<unsigned long long>(results.size()) * s / numSlices));
+
+	int *src = &results[0];
+	int *dst = &scratch[0];
+
+	std::function<void(unsigned int)> sortSlice = [&](unsigned int s)
+	{
+		mergeSort(comparator, src + bounds[s], src + bounds[s + 1], dst + bounds[s]);
+	};
+
+	if (numSlices == 1)
+	{
+		sortSlice(0);
+		return;
+	}
+	m_threadPool->parallelFor(numSlices, sortSlice);
+
+	for (unsigned int width = 1; width < numSlices; width *= 2)
+	{
+		unsigned int numPairs = (numSlices + 2 * width - 1) / (2 * width);
+		unsigned int piecesPerPair = (numSlices + numPairs - 1) / numPairs;
+
+		m_threadPool->parallelFor(numPairs * piecesPerPair, [&](unsigned int task)
+		{
+			unsigned int p = task / piecesPerPair;
+			unsigned int piece = task % piecesPerPair;
+			unsigned int lo = bounds[2 * p * width];
+			unsigned int mid = bounds[std::min(2 * p * width + width, numSlices)];
+			unsigned int hi = bounds[std::min(2 * p * width + 2 * width, numSlices)];
+
+			// Output positions [kBegin, kEnd) of this pair's merge
+			unsigned long long size = hi - lo;
+			unsigned int kBegin = static_cast<unsigned int>(size * piece / piecesPerPair);
+			unsigned int kEnd = static_cast<unsigned int>(size * (piece + 1) / piecesPerPair);
+
+			const int *run1 = src + lo;
+			const int *run2 = src + mid;
+			unsigned int i0 = coRank(comparator, run1, mid - lo, run2, hi - mid, kBegin);
+			unsigned int i1 = coRank(comparator, run1, mid - lo, run2, hi - mid, kEnd);
+			merge(comparator, run1 + i0, run1 + i1, run2 + (kBegin - i0), run2 + (kEnd - i1),
+				dst + lo + kBegin);
+		});
+		std::swap(src, dst);
+	}
+
+	if (src != &results[0])
+		results.swap(scratch);
 }
 
 ////////////////////
@@ -524,25 +1890,30 @@ void Database::merge(std::vector<SortCriterion>& sortCriteria,
 
 bool Database::printBST() const
 {
+	SharedMutex::ReadLock lock(m_lock);
+
 	// Check MultiMap validity
 	if (!validDb())
 		return false;
 	
 	for (unsigned int i = 0; i < m_schemaSize; i++)
-		m_fieldIndex[i]->testPrintInit();
+		if (m_fieldIndex[i] != nullptr)
+			m_fieldIndex[i]->testPrintInit();
 
 	return true;
 }
 
 bool Database::printSchema() const
 {
+	SharedMutex::ReadLock lock(m_lock);
+
 	if (!validDb())
 		return false;
 
 	for (unsigned int i = 0; i < m_schemaSize; i++)
 	{
 		std::cerr << m_schema[i].name << " | " <<
-			m_schema[i].index << std::endl;
+			m_schema[i].index << " | " << m_schema[i].type << std::endl;
 	}
 
 	return true;
@@ -550,13 +1921,15 @@ bool Database::printSchema() const
 
 bool Database::printRows() const
 {
+	SharedMutex::ReadLock lock(m_lock);
+
 	if (!validDb())
 		return false;
 
-	for (unsigned int i = 0; i < m_rows.size(); i++)
+	for (unsigned int i = 0; i < m_columns.getNumRows(); i++)
 	{
-		for (unsigned int k = 0; k < m_rows[i].size(); k++)
-			std::cerr << m_rows[i][k] << " ";
+		for (unsigned int k = 0; k < m_columns.getNumColumns(); k++)
+			std::cerr << m_columns.getCell(i, k) << " ";
 		std::cerr << std::endl;
 	}
 	return true;
@@ -564,11 +1937,14 @@ bool Database::printRows() const
 
 bool Database::printMultiMaps() const
 {
+	SharedMutex::ReadLock lock(m_lock);
+
 	if (!validDb())
 		return false;
 	
 	for (unsigned int i = 0; i < m_schemaSize; i++)
-		m_fieldIndex[i]->testPrintInit();
+		if (m_fieldIndex[i] != nullptr)
+			m_fieldIndex[i]->testPrintInit();
 
 	return true;
 }
\ No newline at end of file
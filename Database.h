@@ -6,21 +6,47 @@
 #include <iostream>
 #include <fstream>  // for input and output files
 #include <sstream>  // for string streams (load from URL to m_loadPageData)
-#include <unordered_set>  // for search criteria
-#include "MultiMap.h"
+#include "FieldIndex.h"
+#include "ColumnStore.h"
+#include "TypedValue.h"
+#include "MappedFile.h"
+#include "WriteAheadLog.h"
+#include "ThreadPool.h"
+#include "RowComparator.h"
+#include "RowBitmap.h"
+#include "RowView.h"
+#include "ResultCache.h"
+#include "SharedMutex.h"
 #include "http.h"
 #include "Tokenizer.h"
 
+// Safe to share between threads: every const method (search, openCursor,
+// getRow, ...) only reads and can run on any number of threads at once,
+// while addRow, the loads and the setters wait for those to finish and run
+// alone. Cursors, RowViews and cells handed out stay valid only until the
+// next change, so a caller that keeps one has to hold off its own writes.
 class Database
 {
 public:
 	enum IndexType { it_none, it_indexed };
 	enum OrderingType { ot_ascending, ot_descending };
+	enum IndexEngine { ie_multiMap = FieldIndex::e_multiMap, ie_bPlusTree = FieldIndex::e_bPlusTree };
+	enum SortMethod { sm_introsort, sm_merge, sm_parallel };
+	enum FieldType { ft_string = TypedValue::vt_string, ft_integer = TypedValue::vt_integer,
+		ft_decimal = TypedValue::vt_decimal, ft_date = TypedValue::vt_date };
 
 	struct FieldDescriptor
 	{
+		FieldDescriptor()
+		{
+			index = it_none;
+			engine = ie_multiMap;
+			type = ft_string;
+		}
 		std::string name;
 		IndexType index;
+		IndexEngine engine;  // Only meaningful for it_indexed fields
+		FieldType type;  // Header line: "Name:int*", "Name:decimal", "Name:date"
 	};
 
 	struct SearchCriterion
@@ -36,19 +62,44 @@ public:
 		OrderingType ordering;
 	};
 
+	class Cursor;
+	class Query;
+
 	static const int ERROR_RESULT = -1;
+	static const unsigned int NO_LIMIT = 0xffffffff;  // search returns every match
 
 	Database();
 	~Database();
 	bool specifySchema(const std::vector<FieldDescriptor>& schema);
+	void setDefaultIndexEngine(IndexEngine engine);  // for schemas read from a header line
+	void setNumThreads(unsigned int numThreads);  // 1 = single threaded loading and sorting
+	void setSortMethod(SortMethod method);  // how search orders its results
+	void setParallelSearch(bool parallel);  // walk the criteria's index ranges at once (needs threads)
+	void setResultCacheBudget(size_t bytes);  // 0 (the default) turns the result cache off
 	bool addRow(const std::vector<std::string>& rowOfData);
+	bool openLog(std::string filename, unsigned int rowsPerSync = 1);  // replays, then logs addRow
+	bool syncLog();  // flushes rows still waiting for the next group sync, false once the log failed
+	void closeLog();
 	bool loadFromURL(std::string url);
 	bool loadFromFile(std::string filename);
+	bool loadFromMappedFile(std::string filename);  // zero copy, keeps the file mapped
+	bool saveSnapshot(std::string filename) const;
+	bool openSnapshot(std::string filename);  // keeps the file mapped, see saveSnapshot
 	int getNumRows() const;
 	bool getRow(int rowNum, std::vector<std::string>& row) const;
+	bool getRowView(int rowNum, RowView& row) const;  // no copying, see RowView
+	bool getCell(int rowNum, unsigned int fieldNum, StringRef& cell) const;
+	// Returns how many rows matched in all; results only holds the page of
+	// up to limit of them that starts offset rows into the sorted matches
 	int search(const std::vector<SearchCriterion>& searchCriteria,
 		const std::vector<SortCriterion>& sortCriteria,
-		std::vector<int>& results);
+		std::vector<int>& results, unsigned int limit = NO_LIMIT, unsigned int offset = 0) const;
+	bool openCursor(const std::vector<SearchCriterion>& searchCriteria,
+		const std::vector<SortCriterion>& sortCriteria, Cursor& cursor) const;
+	bool prepare(const std::vector<SearchCriterion>& searchCriteria,
+		const std::vector<SortCriterion>& sortCriteria, Query& query) const;
+	int search(const Query& query, std::vector<int>& results,
+		unsigned int limit = NO_LIMIT, unsigned int offset = 0) const;
 
 	// Test printing
 	bool printBST() const;
@@ -61,32 +112,141 @@ private:
 	Database(const Database& other);
 	Database& operator=(const Database& rhs);
 
+	// Bounds of one search criterion, resolved against the schema
+	struct Range
+	{
+		unsigned int field;
+		std::string minKey;  // Index key form (encoded for typed fields), empty if not given
+		std::string maxKey;
+		long long minValue;  // Typed fields only, always set
+		long long maxValue;
+		// String fields whose column is dictionary encoded are checked by
+		// code instead: minValue and maxValue then hold the codes in range
+		bool byCode;
+	};
+
+	typedef std::vector<std::pair<unsigned int, bool> > SortKeys;  // (field, descending)
+
 	// Private methods
+	bool setSchema(const std::vector<FieldDescriptor>& schema);
 	bool validDb() const;
 	bool tokenizeFirstLine(std::string firstLine); 
 	bool tokenizeFirstLineFromEntire(const std::string& entireText);  // input from URL
 	void tokenizeLineIntoVector(const std::string& singleLine);
-	void insertIntoFieldIndex(const std::vector<std::string>& row, int rowNum);
-	bool getSearchCriteriaMatches(const std::vector<SearchCriterion>& searchCriteria, 
-		std::vector<int>& results);
+	void tokenizeLineInPlace(const char *begin, const char *end, std::vector<StringRef>& row) const;
+	bool storeRow(const std::vector<std::string>& rowOfData);
+	bool storeMappedRow(const std::vector<StringRef>& row);
+	StringRef indexKey(unsigned int rowNum, unsigned int field, char *keyBuffer) const;
+	void insertIntoFieldIndex(int rowNum);
+	void encodeColumns();
+	void buildFieldIndexes(unsigned int firstRow);
+	bool loadRowsParallel(const char *begin, const char *end, bool mapped);
+	bool makeRanges(const std::vector<SearchCriterion>& searchCriteria,
+		std::vector<Range>& ranges) const;
+	void resolveSortKeys(const std::vector<SortCriterion>& sortCriteria, SortKeys& sortKeys) const;
+	bool findField(const std::string& name, unsigned int& field) const;
+	static bool validBounds(FieldType type, const std::string& minValue,
+		const std::string& maxValue);
+	int searchRanges(const std::vector<Range>& ranges, const SortKeys& sortKeys,
+		std::vector<int>& results, unsigned int limit, unsigned int offset) const;
+	std::string cacheKey(const std::vector<Range>& ranges, const SortKeys& sortKeys) const;
+	static void appendKeyPart(std::string& key, unsigned int number);
+	void invalidateCachedResults(unsigned int rowNum);
+	bool getSearchCriteriaMatches(const std::vector<Range>& ranges,
+		std::vector<int>& results) const;
+	void makeRange(const SearchCriterion& criterion, unsigned int field, Range& range) const;
+	unsigned int countRange(const Range& range) const;
+	FieldIndex::Iterator rangeStart(const Range& range) const;
+	void scanRange(const Range& range, std::vector<int>& rows) const;
+	void scanColumn(const Range& range, std::vector<int>& rows) const;
+	bool rowInRange(unsigned int rowNum, const Range& range) const;
 
 	// Sorting methods
-	void mergeSort(std::vector<SortCriterion>& sortCriteria,
-		std::vector<int>& results, int size);
-	void merge(std::vector<SortCriterion>& sortCriteria, 
-		std::vector<int>& results, int n1, int n2);
+	void sortResults(const RowComparator& comparator, std::vector<int>& results) const;
+	void selectTopResults(const RowComparator& comparator, std::vector<int>& results,
+		unsigned int count) const;
+	void mergeSort(const RowComparator& comparator, int *first, int *last, int *scratch) const;
+	void merge(const RowComparator& comparator, const int *first1, const int *last1,
+		const int *first2, const int *last2, int *out) const;
+	unsigned int coRank(const RowComparator& comparator, const int *first1, unsigned int size1,
+		const int *first2, unsigned int size2, unsigned int k) const;
+	void parallelMergeSort(const RowComparator& comparator, std::vector<int>& results) const;
 
 	// Private data members
-	std::vector<std::vector<std::string> > m_rows;
-	std::vector<MultiMap*> m_fieldIndex;
+	ColumnStore m_columns;
+	std::vector<FieldIndex*> m_fieldIndex;
 	std::vector<FieldDescriptor> m_schema;
-	std::vector<int> m_searchSchemaMap;
-	std::vector<int> m_sortSchemaMap;
 	std::string m_loadPageData;
+	MappedFile m_mappedFile;  // backs every mapped row in m_columns
+	WriteAheadLog m_log;  // closed unless openLog was called
+	ThreadPool *m_threadPool;  // nullptr when running single threaded
+	mutable ResultCache<std::vector<Range> > m_resultCache;  // empty while its budget is 0
+	mutable SharedMutex m_lock;  // shared by readers, exclusive for anything that changes the database
 	unsigned int m_schemaSize;
-	unsigned int m_numberOfLines;
+	IndexEngine m_defaultIndexEngine;
+	SortMethod m_sortMethod;
+	bool m_parallelSearch;
+	unsigned int m_schemaVersion;  // bumped by every new schema, see Query
 	bool m_validDb;
 
 };
 
+// Rows matching one query, handed out one at a time by Database::openCursor.
+// Only usable while the Database it came from is alive and unchanged
+class Database::Cursor
+{
+public:
+	Cursor();
+	bool valid() const;
+	int getRow() const;
+	bool next();
+
+private:
+	friend class Database;
+
+	// Where the rows come from
+	enum Source { cs_none, cs_results, cs_index, cs_column };
+
+	// Private methods
+	void seek();
+	bool matchesOthers(unsigned int rowNum) const;
+
+	// Private data members
+	const Database *m_db;
+	Source m_source;
+	std::vector<Range> m_ranges;
+	unsigned int m_driver;  // cs_index: the range whose index is walked
+	FieldIndex::Iterator m_it;  // cs_index
+	std::vector<int> m_results;  // cs_results: every match, sorted
+	unsigned int m_position;  // cs_results: into m_results, cs_column: next row
+	int m_row;  // current match, -1 once past the last
+
+};
+
+// A search resolved against the schema once by Database::prepare: its field
+// names are looked up and its bounds checked, so Database::search(query)
+// goes straight to the indexes. Only the bounds change between runs. Only
+// runs on the Database that prepared it, and stops working (search fails)
+// once that Database gets a new schema
+class Database::Query
+{
+public:
+	Query();
+	unsigned int size() const;  // number of search criteria
+	bool setBounds(unsigned int criterion, const std::string& minValue,
+		const std::string& maxValue);
+
+private:
+	friend class Database;
+
+	// Private data members
+	std::vector<SearchCriterion> m_criteria;  // with the latest bounds
+	std::vector<unsigned int> m_fields;  // schema field of each criterion
+	std::vector<FieldType> m_types;
+	SortKeys m_sortKeys;
+	const Database *m_db;  // the Database that prepared it, the only one it runs on
+	unsigned int m_schemaVersion;  // Database::m_schemaVersion when prepared
+
+};
+
 #endif  // DATABASE_H
\ No newline at end of file
@@ -0,0 +1,282 @@
+#include "FieldIndex.h"
+
+FieldIndex::Iterator::Iterator()
+{
+	m_engine = e_multiMap;
+}
+
+FieldIndex::Iterator::Iterator(const MultiMap::Iterator& it)
+{
+	m_engine = e_multiMap;
+	m_multiMapIt = it;
+}
+
+FieldIndex::Iterator::Iterator(const BPlusTree::Iterator& it)
+{
+	m_engine = e_bPlusTree;
+	m_bPlusTreeIt = it;
+}
+
+FieldIndex::Iterator::Iterator(const SortedRun::Iterator& it)
+{
+	m_engine = e_sortedRun;
+	m_sortedRunIt = it;
+}
+
+bool FieldIndex::Iterator::valid() const
+{
+	if (m_engine == e_sortedRun)
+		return m_sortedRunIt.valid();
+	if (m_engine == e_bPlusTree)
+		return m_bPlusTreeIt.valid();
+	return m_multiMapIt.valid();
+}
+
+StringRef FieldIndex::Iterator::getKey() const
+{
+	if (m_engine == e_sortedRun)
+		return m_sortedRunIt.getKey();
+	if (m_engine == e_bPlusTree)
+		return m_bPlusTreeIt.getKey();
+	return m_multiMapIt.getKey();
+}
+
+unsigned int FieldIndex::Iterator::getValue() const
+{
+	if (m_engine == e_sortedRun)
+		return m_sortedRunIt.getValue();
+	if (m_engine == e_bPlusTree)
+		return m_bPlusTreeIt.getValue();
+	return m_multiMapIt.getValue();
+}
+
+bool FieldIndex::Iterator::next()
+{
+	if (m_engine == e_sortedRun)
+		return m_sortedRunIt.next();
+	if (m_engine == e_bPlusTree)
+		return m_bPlusTreeIt.next();
+	return m_multiMapIt.next();
+}
+
+bool FieldIndex::Iterator::prev()
+{
+	if (m_engine == e_sortedRun)
+		return m_sortedRunIt.prev();
+	if (m_engine == e_bPlusTree)
+		return m_bPlusTreeIt.prev();
+	return m_multiMapIt.prev();
+}
+
+FieldIndex::FieldIndex(Engine engine)
+{
+	m_engine = engine;
+	m_multiMap = nullptr;
+	m_bPlusTree = nullptr;
+	m_sortedRun = nullptr;
+
+	if (m_engine == e_bPlusTree)
+		m_bPlusTree = new BPlusTree;
+	else
+		m_multiMap = new MultiMap;
+}
+
+FieldIndex::~FieldIndex()
+{
+	delete m_multiMap;
+	delete m_bPlusTree;
+	delete m_sortedRun;
+}
+
+FieldIndex::Engine FieldIndex::getEngine() const
+{
+	return m_engine;
+}
+
+void FieldIndex::clear()
+{
+	delete m_sortedRun;
+	m_sortedRun = nullptr;
+
+	if (m_engine == e_bPlusTree)
+		m_bPlusTree->clear();
+	else
+		m_multiMap->clear();
+}
+
+void FieldIndex::insert(const StringRef& key, unsigned int value)
+{
+	if (m_sortedRun != nullptr)
+		loadSortedRun();
+
+	if (m_engine == e_bPlusTree)
+		m_bPlusTree->insert(key, value);
+	else
+		m_multiMap->insert(key, value);
+}
+
+// sorted must be ordered by key, then by value (see MultiMap::bulkLoad)
+void FieldIndex::bulkLoad(const std::vector<std::pair<StringRef, unsigned int> >& sorted)
+{
+	delete m_sortedRun;
+	m_sortedRun = nullptr;
+
+	if (m_engine == e_bPlusTree)
+		m_bPlusTree->bulkLoad(sorted);
+	else
+		m_multiMap->bulkLoad(sorted);
+}
+
+FieldIndex::Iterator FieldIndex::findEqual(const std::string& key) const
+{
+	if (m_sortedRun != nullptr)
+		return Iterator(m_sortedRun->findEqual(key));
+	if (m_engine == e_bPlusTree)
+		return Iterator(m_bPlusTree->findEqual(key));
+	return Iterator(m_multiMap->findEqual(key));
+}
+
+FieldIndex::Iterator FieldIndex::findEqualOrSuccessor(const std::string& key) const
+{
+	if (m_sortedRun != nullptr)
+		return Iterator(m_sortedRun->findEqualOrSuccessor(key));
+	if (m_engine == e_bPlusTree)
+		return Iterator(m_bPlusTree->findEqualOrSuccessor(key));
+	return Iterator(m_multiMap->findEqualOrSuccessor(key));
+}
+
+FieldIndex::Iterator FieldIndex::findEqualOrPredecessor(const std::string& key) const
+{
+	if (m_sortedRun != nullptr)
+		return Iterator(m_sortedRun->findEqualOrPredecessor(key));
+	if (m_engine == e_bPlusTree)
+		return Iterator(m_bPlusTree->findEqualOrPredecessor(key));
+	return Iterator(m_multiMap->findEqualOrPredecessor(key));
+}
+
+// Number of rows indexed, in total or under a range of keys
+unsigned int FieldIndex::size() const
+{
+	if (m_sortedRun != nullptr)
+		return m_sortedRun->size();
+	if (m_engine == e_bPlusTree)
+		return m_bPlusTree->size();
+	return m_multiMap->size();
+}
+
+unsigned int FieldIndex::countLess(const std::string& key) const
+{
+	if (m_sortedRun != nullptr)
+		return m_sortedRun->countLess(key);
+	if (m_engine == e_bPlusTree)
+		return m_bPlusTree->countLess(key);
+	return m_multiMap->countLess(key);
+}
+
+unsigned int FieldIndex::countLessOrEqual(const std::string& key) const
+{
+	if (m_sortedRun != nullptr)
+		return m_sortedRun->countLessOrEqual(key);
+	if (m_engine == e_bPlusTree)
+		return m_bPlusTree->countLessOrEqual(key);
+	return m_multiMap->countLessOrEqual(key);
+}
+
+unsigned int FieldIndex::countRange(const std::string& min, const std::string& max) const
+{
+	if (m_sortedRun != nullptr)
+		return m_sortedRun->countRange(min, max);
+	if (m_engine == e_bPlusTree)
+		return m_bPlusTree->countRange(min, max);
+	return m_multiMap->countRange(min, max);
+}
+
+// Writes every entry in order as a sorted run: the number of entries, the
+// offsets of their keys, the key bytes, then the values
+void FieldIndex::saveSnapshot(SnapshotWriter& out) const
+{
+	unsigned int count = size();
+	out.writeU32(count);
+
+	out.align();
+	unsigned int offset = 0;
+	out.writeU32(offset);
+	for (Iterator it = findEqualOrSuccessor(""); it.valid(); it.next())
+	{
+		offset += it.getKey().size;
+		out.writeU32(offset);
+	}
+
+	out.align();
+	for (Iterator it = findEqualOrSuccessor(""); it.valid(); it.next())
+		out.write(it.getKey().data, it.getKey().size);
+
+	out.align();
+	for (Iterator it = findEqualOrSuccessor(""); it.valid(); it.next())
+		out.writeU32(it.getValue());
+}
+
+// Must be O(N). Answers from the run written by saveSnapshot, in place, from
+// now until the index is changed. False if the run doesn't fit in the input,
+// its key offsets are out of order or a value isn't one of the numRows rows
+bool FieldIndex::openSnapshot(SnapshotReader& in, unsigned int numRows)
+{
+	unsigned int count;
+	if (!in.readU32(count))
+		return false;
+
+	const unsigned int *keyOffsets = static_cast<const unsigned int*>(
+		in.readArray(static_cast<size_t>(count) + 1, sizeof(unsigned int)));
+	if (keyOffsets == nullptr || !SnapshotReader::validOffsets(keyOffsets, count))
+		return false;
+
+	in.align();
+	const char *keyBytes = in.readBytes(keyOffsets[count]);
+	const unsigned int *values = static_cast<const unsigned int*>(
+		in.readArray(count, sizeof(unsigned int)));
+	if (keyBytes == nullptr || values == nullptr)
+		return false;
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (values[i] >= numRows)
+			return false;
+	}
+
+	clear();
+	m_sortedRun = new SortedRun(keyOffsets, keyBytes, values, count);
+	return true;
+}
+
+/////////////////////
+/* PRIVATE METHODS */
+/////////////////////
+
+// Moves the entries of the snapshot run into the engine, which can change
+void FieldIndex::loadSortedRun()
+{
+	std::vector<std::pair<StringRef, unsigned int> > sorted(m_sortedRun->size());
+	for (unsigned int i = 0; i < sorted.size(); i++)
+		sorted[i] = std::make_pair(m_sortedRun->getKey(i), m_sortedRun->getValue(i));
+
+	bulkLoad(sorted);
+}
+
+////////////////////
+/* TEST FUNCTIONS */
+////////////////////
+
+void FieldIndex::testPrintInit()
+{
+	if (m_sortedRun != nullptr)
+	{
+		for (unsigned int i = 0; i < m_sortedRun->size(); i++)
+			std::cerr << m_sortedRun->getKey(i) << " : " << m_sortedRun->getValue(i) << std::endl;
+		return;
+	}
+
+	if (m_engine == e_bPlusTree)
+		m_bPlusTree->testPrintInit();
+	else
+		m_multiMap->testPrintInit();
+}
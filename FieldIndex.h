@@ -0,0 +1,77 @@
+#ifndef FIELDINDEX_H
+#define FIELDINDEX_H
+
+#include <string>
+#include "MultiMap.h"
+#include "BPlusTree.h"
+#include "SortedRun.h"
+#include "Snapshot.h"
+
+// One per schema field in Database::m_fieldIndex. Forwards to whichever
+// index engine the field was created with, so the search code does not
+// care which one is underneath.
+//
+// An index opened from a snapshot answers from the sorted run in the file
+// (e_sortedRun) until it is first changed, when its entries are loaded into
+// its own engine.
+class FieldIndex
+{
+public:
+	enum Engine { e_multiMap, e_bPlusTree, e_sortedRun };
+
+	class Iterator
+	{
+	public:
+		Iterator();
+		Iterator(const MultiMap::Iterator& it);
+		Iterator(const BPlusTree::Iterator& it);
+		Iterator(const SortedRun::Iterator& it);
+		bool valid() const;
+		StringRef getKey() const;
+		unsigned int getValue() const;
+		bool next();
+		bool prev();
+
+	private:
+		Engine m_engine;
+		MultiMap::Iterator m_multiMapIt;
+		BPlusTree::Iterator m_bPlusTreeIt;
+		SortedRun::Iterator m_sortedRunIt;
+	};
+
+	FieldIndex(Engine engine);  // e_multiMap or e_bPlusTree
+	~FieldIndex();
+	Engine getEngine() const;
+	void clear();
+	void insert(const StringRef& key, unsigned int value);
+	void bulkLoad(const std::vector<std::pair<StringRef, unsigned int> >& sorted);
+	Iterator findEqual(const std::string& key) const;
+	Iterator findEqualOrSuccessor(const std::string& key) const;
+	Iterator findEqualOrPredecessor(const std::string& key) const;
+	unsigned int size() const;
+	unsigned int countLess(const std::string& key) const;
+	unsigned int countLessOrEqual(const std::string& key) const;
+	unsigned int countRange(const std::string& min, const std::string& max) const;
+	void saveSnapshot(SnapshotWriter& out) const;
+	bool openSnapshot(SnapshotReader& in, unsigned int numRows);
+
+	// Test printing
+	void testPrintInit();
+
+private:
+	// Prevents FieldIndexes from being copied or assigned
+	FieldIndex(const FieldIndex& other);
+	FieldIndex& operator=(const FieldIndex& rhs);
+
+	// Private methods
+	void loadSortedRun();
+
+	// Private data members (exactly one of the two engines is non null)
+	Engine m_engine;
+	MultiMap *m_multiMap;
+	BPlusTree *m_bPlusTree;
+	SortedRun *m_sortedRun;  // answers instead of the engine while non null
+
+};
+
+#endif  // FIELDINDEX_H
@@ -0,0 +1,152 @@
+#include "MappedFile.h"
+#include <algorithm>
+
+#ifdef _MSC_VER  // Windows
+
+#include <windows.h>
+
+#else  //  Mac OS X and LINUX
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#endif
+
+MappedFile::MappedFile()
+{
+	m_data = nullptr;
+	m_size = 0;
+	m_open = false;
+#ifdef _MSC_VER
+	m_fileHandle = m_mappingHandle = nullptr;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+// ap_sequential suits a file read front to back once (a CSV load), and has
+// the OS read far ahead and drop pages soon after. ap_random suits a file
+// kept mapped and searched (a snapshot), where reading ahead is wasted
+bool MappedFile::open(const std::string& filename, AccessPattern access)
+{
+	close();
+
+#ifdef _MSC_VER
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		access == ap_sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize))
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	m_fileHandle = file;
+	m_size = static_cast<size_t>(fileSize.QuadPart);
+
+	// Windows refuses to map an empty file; an empty mapping is still valid
+	if (m_size > 0)
+	{
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL)
+		{
+			close();
+			return false;
+		}
+		m_mappingHandle = mapping;
+
+		m_data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		if (m_data == nullptr)
+		{
+			close();
+			return false;
+		}
+	}
+#else
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	m_size = static_cast<size_t>(st.st_size);
+	if (m_size > 0)
+	{
+		void *addr = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (addr == MAP_FAILED)
+		{
+			::close(fd);
+			m_size = 0;
+			return false;
+		}
+		m_data = static_cast<const char*>(addr);
+
+		madvise(addr, m_size, access == ap_sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+	}
+
+	// The mapping keeps its own reference to the file
+	::close(fd);
+#endif
+
+	m_open = true;
+	return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _MSC_VER
+	if (m_data != nullptr)
+		UnmapViewOfFile(m_data);
+	if (m_mappingHandle != nullptr)
+		CloseHandle(m_mappingHandle);
+	if (m_fileHandle != nullptr)
+		CloseHandle(m_fileHandle);
+	m_fileHandle = m_mappingHandle = nullptr;
+#else
+	if (m_data != nullptr)
+		munmap(const_cast<char*>(m_data), m_size);
+#endif
+
+	m_data = nullptr;
+	m_size = 0;
+	m_open = false;
+}
+
+void MappedFile::swap(MappedFile& other)
+{
+	std::swap(m_data, other.m_data);
+	std::swap(m_size, other.m_size);
+	std::swap(m_open, other.m_open);
+#ifdef _MSC_VER
+	std::swap(m_fileHandle, other.m_fileHandle);
+	std::swap(m_mappingHandle, other.m_mappingHandle);
+#endif
+}
+
+bool MappedFile::isOpen() const
+{
+	return m_open;
+}
+
+const char* MappedFile::data() const
+{
+	return m_data;
+}
+
+size_t MappedFile::size() const
+{
+	return m_size;
+}
@@ -0,0 +1,40 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <cstddef>
+
+// Read only memory mapping of an entire file. The bytes stay valid until
+// close() is called or the object is destroyed.
+class MappedFile
+{
+public:
+	// How the bytes will be read, passed on to the OS as a hint
+	enum AccessPattern { ap_sequential, ap_random };
+
+	MappedFile();
+	~MappedFile();
+	bool open(const std::string& filename, AccessPattern access);
+	void close();
+	void swap(MappedFile& other);
+	bool isOpen() const;
+	const char* data() const;
+	size_t size() const;
+
+private:
+	// Prevents MappedFiles from being copied or assigned
+	MappedFile(const MappedFile& other);
+	MappedFile& operator=(const MappedFile& rhs);
+
+	// Private data members
+	const char *m_data;
+	size_t m_size;
+	bool m_open;
+#ifdef _MSC_VER
+	void *m_fileHandle;
+	void *m_mappingHandle;
+#endif
+
+};
+
+#endif  // MAPPEDFILE_H
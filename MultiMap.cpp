@@ -1,4 +1,5 @@
 #include "MultiMap.h"
+#include <cstring>  // for memcpy
 
 // Must be O(1)
 MultiMap::Iterator::Iterator()
@@ -10,8 +11,7 @@ MultiMap::Iterator::Iterator()
 MultiMap::Iterator::Iterator(Node *init)
 {
 	m_ptrToNode = init;
-	m_ptrToNodeList = m_ptrToNode->val;
-	m_currentDuplicateValue = m_ptrToNode->val->value;
+	m_valueIndex = 0;
 	m_valid = true;
 }
 
@@ -20,8 +20,7 @@ MultiMap::Iterator::Iterator(Node *init, int x)
 {
 	m_ptrToNode = init;
 	// Initializes duplicate value to the end value
-	m_ptrToNodeList = m_ptrToNode->tail;
-	m_currentDuplicateValue = m_ptrToNode->tail->value;
+	m_valueIndex = m_ptrToNode->numValues - 1;
 	m_valid = true;
 }
 
@@ -31,10 +30,10 @@ bool MultiMap::Iterator::valid() const
 }
 
 // Must be O(1)
-std::string MultiMap::Iterator::getKey() const
+StringRef MultiMap::Iterator::getKey() const
 {
 	if (!valid())
-		return "ERROR";
+		return StringRef("ERROR");
 
 	return m_ptrToNode->key;
 }
@@ -44,7 +43,7 @@ unsigned int MultiMap::Iterator::getValue() const
 	if (!valid())
 		return -1;
 
-	return m_currentDuplicateValue;
+	return m_ptrToNode->values[m_valueIndex];
 }
 
 bool MultiMap::Iterator::next()
@@ -52,63 +51,44 @@ bool MultiMap::Iterator::next()
 	if (!valid())
 		return false;
 
-	while (m_ptrToNode != nullptr)
+	// Check for remaining duplicates of the current key first
+	if (m_valueIndex + 1 < m_ptrToNode->numValues)
 	{
-		// check is cur->duplicate counter is greater than 0
-		// if it is, check where this (next or prev) function last left off
-		if (m_ptrToNode->duplicateTotal > 0)
-		{
-			if (m_ptrToNodeList->next != nullptr)
-			{
-				m_ptrToNodeList = m_ptrToNodeList->next;
-				m_currentDuplicateValue = m_ptrToNodeList->value;
-				return true;
-			}
-		}
+		m_valueIndex++;
+		return true;
+	}
 
-		// Check non nullptr right child
-		if (m_ptrToNode->right != nullptr)
-		{
-			m_ptrToNode = m_ptrToNode->right;
-			// Now check for left children
-			if (m_ptrToNode->left == nullptr)
-			{
-				m_ptrToNodeList = m_ptrToNode->val;
-				m_currentDuplicateValue = m_ptrToNodeList->value;
-				return true;
-			}
-			else
-			{
-				while (m_ptrToNode->left != nullptr)
-					m_ptrToNode = m_ptrToNode->left;
+	// If there is a right child, the successor is the left most node
+	// of the right subtree
+	if (m_ptrToNode->right != nullptr)
+	{
+		m_ptrToNode = m_ptrToNode->right;
+		while (m_ptrToNode->left != nullptr)
+			m_ptrToNode = m_ptrToNode->left;
+	}
 
-				m_ptrToNodeList = m_ptrToNode->val;
-				m_currentDuplicateValue = m_ptrToNodeList->value;
-				return true;
-			}
+	// Otherwise loop up through the parents until we arrive from a left child.
+	// Comparing pointers instead of keys avoids a string compare per level
+	else
+	{
+		Node *child = m_ptrToNode;
+		m_ptrToNode = m_ptrToNode->parent;
+		while (m_ptrToNode != nullptr && child == m_ptrToNode->right)
+		{
+			child = m_ptrToNode;
+			m_ptrToNode = m_ptrToNode->parent;
 		}
 
-		// If right child nullptr, check parent (loop up through parents)
-		if (m_ptrToNode->right == nullptr)
+		if (m_ptrToNode == nullptr)
 		{
-			std::string tempKey = m_ptrToNode->key;
-			while (m_ptrToNode->parent != nullptr)
-			{
-				m_ptrToNode = m_ptrToNode->parent;
-				if (m_ptrToNode->key > tempKey)
-				{
-					m_ptrToNodeList = m_ptrToNode->val;
-					m_currentDuplicateValue = m_ptrToNodeList->value;
-					return true;
-				}
-			}
 			// Invalidates iterator to prevent undefined behavior
 			invalidateIterator();
 			return false;
 		}
 	}
-	invalidateIterator();
-	return false;
+
+	m_valueIndex = 0;
+	return true;
 }
 
 bool MultiMap::Iterator::prev()
@@ -116,67 +96,43 @@ bool MultiMap::Iterator::prev()
 	if (!valid())
 		return false;
 
-	while (m_ptrToNode != nullptr)
+	// First check for duplicate values before the current position
+	if (m_valueIndex > 0)
 	{
-		// First check for duplicate values beginning from current tail pointer
-		if (m_ptrToNode->duplicateTotal > 0)
-		{
-			if (m_ptrToNodeList->prev != nullptr)
-			{
-				m_ptrToNodeList = m_ptrToNodeList->prev;
-				m_currentDuplicateValue = m_ptrToNodeList->value;
-				return true;
-			}
-		}
-
-		// If left child is not nullptr go down that branch 
-		// and check if that child has a right child
-		if (m_ptrToNode->left != nullptr)
-		{
-			m_ptrToNode = m_ptrToNode->left;
+		m_valueIndex--;
+		return true;
+	}
 
-			// If that child has a right child, loop down the right child branch
-			// until we hit a nullptr
-			if (m_ptrToNode->right != nullptr)
-			{
-				while (m_ptrToNode->right != nullptr)
-					m_ptrToNode = m_ptrToNode->right;
-				m_ptrToNodeList = m_ptrToNode->tail;
-				m_currentDuplicateValue = m_ptrToNodeList->value;
-				return true;
-			}
+	// If there is a left child, the predecessor is the right most node
+	// of the left subtree
+	if (m_ptrToNode->left != nullptr)
+	{
+		m_ptrToNode = m_ptrToNode->left;
+		while (m_ptrToNode->right != nullptr)
+			m_ptrToNode = m_ptrToNode->right;
+	}
 
-			// Otherwise if right child is nullptr, we are at the right (prev) spot
-			else
-			{
-				m_ptrToNodeList = m_ptrToNode->tail;
-				m_currentDuplicateValue = m_ptrToNodeList->value;
-				return true;
-			}
+	// Otherwise loop up through the parents until we arrive from a right child
+	// (return false if we run out of parents)
+	else
+	{
+		Node *child = m_ptrToNode;
+		m_ptrToNode = m_ptrToNode->parent;
+		while (m_ptrToNode != nullptr && child == m_ptrToNode->left)
+		{
+			child = m_ptrToNode;
+			m_ptrToNode = m_ptrToNode->parent;
 		}
 
-		// If left child IS a nullptr, loop through parents until we find
-		// the first node that is less than the current key or until
-		// we hit a parent nullptr (return false in this case)
-		if (m_ptrToNode->left == nullptr)
+		if (m_ptrToNode == nullptr)
 		{
-			std::string tempKey = m_ptrToNode->key;
-			while (m_ptrToNode->parent != nullptr)
-			{
-				m_ptrToNode = m_ptrToNode->parent;
-				if (m_ptrToNode->key < tempKey)
-				{
-					m_ptrToNodeList = m_ptrToNode->tail;
-					m_currentDuplicateValue = m_ptrToNodeList->value;
-					return true;
-				}
-			}
 			invalidateIterator();
 			return false;
 		}
 	}
-	invalidateIterator();
-	return false;
+
+	m_valueIndex = m_ptrToNode->numValues - 1;
+	return true;
 }
 
 // Must be O(1)
@@ -185,87 +141,131 @@ MultiMap::MultiMap()
 	m_root = nullptr;
 }
 
-// Must be O(N)
+// Must be O(number of arena slabs)
 MultiMap::~MultiMap()
 {
-	clear();
 }
 
-// Must be O(N)
+// Must be O(number of arena slabs). Nodes need no destructing, dropping the
+// arena frees them all
 void MultiMap::clear()
 {
-	Node *temp = m_root;
-	clearBST(temp);
+	m_root = nullptr;
+	m_arena.clear();
 }
 
-void MultiMap::insert(std::string key, unsigned int value)
+// Must be O(log N) regardless of the order keys arrive in
+void MultiMap::insert(const StringRef& key, unsigned int value)
 {
 	// Check for empty tree
 	if (m_root == nullptr)
 	{
-		m_root = new Node(key, value);
+		m_root = newNode(key, 1);
+		appendValue(m_root, value);
+		m_root->red = false;
 		return;
 	}
 
 	Node *cur = m_root;
 	for (;;)
 	{
-		// For duplicate key values
-		if (key == cur->key)
-		{
-			NodeList *duplicateKey = new NodeList(value);
-			NodeList *currentVal = cur->val;
+		// Every node on the way down gains the one new value below it
+		cur->size++;
 
-			while (currentVal->next != nullptr)
-				currentVal = currentVal->next;
+		int cmp = key.compare(cur->key);
 
-			currentVal->next = duplicateKey;
-			duplicateKey->prev = currentVal;
-			cur->tail = duplicateKey;
-			cur->duplicateTotal++;
+		// For duplicate key values, append to the key's posting list. The tree
+		// shape does not change so no rebalancing is needed
+		if (cmp == 0)
+		{
+			appendValue(cur, value);
 			return;
 		}
 
-		if (key < cur->key)
+		if (cmp < 0)
 		{
 			if (cur->left != nullptr)
 				cur = cur->left;
 			else
 			{
-				cur->left = new Node(key, value);
+				cur->left = newNode(key, 1);
+				appendValue(cur->left, value);
 				cur->left->parent = cur;
+				insertFixup(cur->left);
 				return;
 			}
 		}
 
-		else if (key > cur->key)
+		else  // key > cur->key
 		{
 			if (cur->right != nullptr)
 				cur = cur->right;
 			else
 			{
-				cur->right = new Node(key, value);
+				cur->right = newNode(key, 1);
+				appendValue(cur->right, value);
 				cur->right->parent = cur;
+				insertFixup(cur->right);
 				return;
 			}
 		}
 	}
 }
 
-MultiMap::Iterator MultiMap::findEqual(std::string key) const
+// Must be O(N). Replaces the contents with the (key, value) pairs in sorted,
+// which must be ordered by key and then by value. Iterating the result gives
+// exactly what inserting the pairs one at a time in that order would
+void MultiMap::bulkLoad(const std::vector<std::pair<StringRef, unsigned int> >& sorted)
+{
+	clear();
+
+	// One node per run of equal keys, already in order, with a posting list
+	// just big enough for the run. Nodes come out of the arena in key order
+	// so iterating the tree walks memory in order too
+	std::vector<Node*> nodes;
+	unsigned int begin = 0;
+	while (begin < sorted.size())
+	{
+		unsigned int end = begin + 1;
+		while (end < sorted.size() && sorted[end].first == sorted[begin].first)
+			end++;
+
+		Node *cur = newNode(sorted[begin].first, end - begin);
+		for (unsigned int i = begin; i < end; i++)
+			appendValue(cur, sorted[i].second);
+		nodes.push_back(cur);
+
+		begin = end;
+	}
+
+	if (nodes.empty())
+		return;
+
+	// Depth of the deepest node once linked, floor(log2(number of nodes))
+	unsigned int maxDepth = 0;
+	while ((2u << maxDepth) <= nodes.size())
+		maxDepth++;
+
+	m_root = linkBalanced(nodes, 0, nodes.size(), nullptr, 0, maxDepth);
+}
+
+// Must be O(log N)
+MultiMap::Iterator MultiMap::findEqual(const std::string& key) const
 {
 	Node *cur = m_root;
 	Iterator it;
 
 	while (cur != nullptr)
 	{
-		if (key == cur->key)
+		int cmp = StringRef(key).compare(cur->key);
+
+		if (cmp == 0)
 		{
 			it = cur;
 			return it;
 		}
 
-		else if (key < cur->key)
+		else if (cmp < 0)
 			cur = cur->left;
 
 		else
@@ -275,59 +275,58 @@ MultiMap::Iterator MultiMap::findEqual(std::string key) const
 	return it;
 }
 
-MultiMap::Iterator MultiMap::findEqualOrSuccessor(std::string key) const
+// Must be O(log N)
+MultiMap::Iterator MultiMap::findEqualOrSuccessor(const std::string& key) const
 {
 	Node *cur = m_root;
+	Node *successor = nullptr;
 	Iterator it;
 
+	// Single descent: every node we turn left at is larger than key, and the
+	// last one of those is the smallest key that is still larger
 	while (cur != nullptr)
 	{
-		if (key == cur->key)
+		int cmp = StringRef(key).compare(cur->key);
+
+		if (cmp == 0)
 		{
 			Iterator validIt(cur);
 			return validIt;
 		}
 
-		else if (key < cur->key)
+		else if (cmp < 0)
 		{
-			if (cur->left == nullptr)
-			{
-				Iterator validIt(cur);
-				return validIt;
-			}
+			successor = cur;
 			cur = cur->left;
 		}
 
 		else  // key > cur->key
-		{
-			if (cur->right == nullptr)
-			{
-				Node *tempCur = cur;
-				while (tempCur->parent != nullptr)
-				{
-					tempCur = tempCur->parent;
-					if (tempCur->key > key)
-					{
-						Iterator validIt(tempCur);
-						return validIt;
-					}
-				}
-			}
 			cur = cur->right;
-		}
+	}
+
+	if (successor != nullptr)
+	{
+		Iterator validIt(successor);
+		return validIt;
 	}
 
 	return it;
 }
 
-MultiMap::Iterator MultiMap::findEqualOrPredecessor(std::string key) const
+// Must be O(log N)
+MultiMap::Iterator MultiMap::findEqualOrPredecessor(const std::string& key) const
 {
 	Node *cur = m_root;
+	Node *predecessor = nullptr;
 	Iterator it;
 
+	// Mirror of findEqualOrSuccessor: the last node we turn right at is the
+	// largest key that is still smaller
 	while (cur != nullptr)
 	{
-		if (key == cur->key)
+		int cmp = StringRef(key).compare(cur->key);
+
+		if (cmp == 0)
 		{
 			// Specific constructor to predecessor
 			// TODO: CHANGE BECAUSE BAD STYLE FUCNTIONLESS PARAMETER (0)
@@ -335,44 +334,52 @@ MultiMap::Iterator MultiMap::findEqualOrPredecessor(std::string key) const
 			return validIt;
 		}
 
-		else if (key < cur->key)
-		{
+		else if (cmp < 0)
 			cur = cur->left;
-		}
 
 		else  // key > cur->key
 		{
-			if (cur->right == nullptr)
-			{
-				Iterator validIt(cur, 0);
-				return validIt;
-			}
-			else if (cur->right->key > key &&
-				cur->right->left == nullptr)
-			{
-				Iterator validIt(cur, 0);
-				return validIt;
-			}
-			else // go down all the way to the left most child and compare with cur
-			{
-				Node* tempCur = cur;
-				tempCur = tempCur->right;
-				while (tempCur->left != nullptr)
-					tempCur = tempCur->left;
-				if (tempCur->key > key)
-				{
-					Iterator validIt(cur, 0);
-					return validIt;
-				}
-			}
-
+			predecessor = cur;
 			cur = cur->right;
 		}
 	}
 
+	if (predecessor != nullptr)
+	{
+		Iterator validIt(predecessor, 0);
+		return validIt;
+	}
+
 	return it;
 }
 
+// Must be O(1). Total number of values, duplicates included
+unsigned int MultiMap::size() const
+{
+	return subtreeSize(m_root);
+}
+
+// Must be O(log N). Number of values under keys < key
+unsigned int MultiMap::countLess(const std::string& key) const
+{
+	return rank(key, false);
+}
+
+// Must be O(log N). Number of values under keys <= key
+unsigned int MultiMap::countLessOrEqual(const std::string& key) const
+{
+	return rank(key, true);
+}
+
+// Must be O(log N). Number of values under keys in [min, max]
+unsigned int MultiMap::countRange(const std::string& min, const std::string& max) const
+{
+	if (max < min)
+		return 0;
+
+	return countLessOrEqual(max) - countLess(min);
+}
+
 /////////////////////
 /* PRIVATE METHODS */
 /////////////////////
@@ -382,30 +389,217 @@ void MultiMap::Iterator::invalidateIterator()
 	m_valid = false;
 }
 
-void MultiMap::clearBST(Node *cur) const
+// Node with an empty posting list that has room for capacity values
+MultiMap::Node* MultiMap::newNode(const StringRef& key, unsigned int capacity)
 {
-	if (cur == nullptr)
-		return;
+	Node *cur = static_cast<Node*>(m_arena.allocate(sizeof(Node)));
+
+	char *keyData = static_cast<char*>(m_arena.allocate(key.size, 1));
+	std::memcpy(keyData, key.data, key.size);
+	cur->key = StringRef(keyData, key.size);
+
+	cur->values = &cur->firstValue;
+	cur->capacity = 1;
+	if (capacity > 1)
+	{
+		cur->values = static_cast<unsigned int*>(m_arena.allocate(capacity * sizeof(unsigned int)));
+		cur->capacity = capacity;
+	}
+	cur->numValues = 0;
 
-	clearBST(cur->left);
-	clearBST(cur->right);
+	cur->left = cur->right = cur->parent = nullptr;
+	cur->red = true;  // New nodes always enter the tree red
+	cur->size = 1;
+	return cur;
+}
 
-	clearNodeList(cur);
+// Amortized O(1). Outgrown posting lists stay behind in the arena, but as
+// each one is double the last they never add up to more than the live ones
+void MultiMap::appendValue(Node *cur, unsigned int value)
+{
+	if (cur->numValues == cur->capacity)
+	{
+		unsigned int *bigger = static_cast<unsigned int*>(
+			m_arena.allocate(2 * cur->capacity * sizeof(unsigned int)));
+		std::memcpy(bigger, cur->values, cur->numValues * sizeof(unsigned int));
+		cur->values = bigger;
+		cur->capacity *= 2;
+	}
 
-	delete cur;
+	cur->values[cur->numValues++] = value;
 }
 
-void MultiMap::clearNodeList(Node *cur) const
+// Single descent, adding up everything left of the path
+unsigned int MultiMap::rank(const std::string& key, bool inclusive) const
 {
-	NodeList *temp = cur->val;
+	Node *cur = m_root;
+	unsigned int count = 0;
 
-	while (temp != nullptr)
+	while (cur != nullptr)
 	{
-		NodeList *nextOne;
-		nextOne = temp->next;
-		delete temp;
-		temp = nextOne;
+		int cmp = StringRef(key).compare(cur->key);
+
+		if (cmp == 0)
+			return count + subtreeSize(cur->left) + (inclusive ? cur->numValues : 0);
+
+		else if (cmp < 0)
+			cur = cur->left;
+
+		else  // key > cur->key
+		{
+			count += subtreeSize(cur->left) + cur->numValues;
+			cur = cur->right;
+		}
 	}
+
+	return count;
+}
+
+unsigned int MultiMap::subtreeSize(const Node *cur)
+{
+	return cur == nullptr ? 0 : cur->size;
+}
+
+// Recomputes cur's size from its children, which must already be right
+void MultiMap::updateSize(Node *cur)
+{
+	cur->size = cur->numValues + subtreeSize(cur->left) + subtreeSize(cur->right);
+}
+
+// Rotations keep the subtree sizes right: y takes over x's whole subtree and
+// x is recomputed from its new children
+void MultiMap::rotateLeft(Node *x)
+{
+	Node *y = x->right;
+
+	x->right = y->left;
+	if (y->left != nullptr)
+		y->left->parent = x;
+
+	y->parent = x->parent;
+	if (x->parent == nullptr)
+		m_root = y;
+	else if (x == x->parent->left)
+		x->parent->left = y;
+	else
+		x->parent->right = y;
+
+	y->left = x;
+	x->parent = y;
+
+	y->size = x->size;
+	updateSize(x);
+}
+
+void MultiMap::rotateRight(Node *x)
+{
+	Node *y = x->left;
+
+	x->left = y->right;
+	if (y->right != nullptr)
+		y->right->parent = x;
+
+	y->parent = x->parent;
+	if (x->parent == nullptr)
+		m_root = y;
+	else if (x == x->parent->right)
+		x->parent->right = y;
+	else
+		x->parent->left = y;
+
+	y->right = x;
+	x->parent = y;
+
+	y->size = x->size;
+	updateSize(x);
+}
+
+// Restores the red-black properties after z (always red) has been linked in.
+// At most two rotations are performed; recoloring may walk up to the root
+void MultiMap::insertFixup(Node *z)
+{
+	while (z->parent != nullptr && z->parent->red)
+	{
+		Node *grandparent = z->parent->parent;
+
+		if (z->parent == grandparent->left)
+		{
+			Node *uncle = grandparent->right;
+
+			// Case 1: red uncle, push the blackness down from the grandparent
+			if (uncle != nullptr && uncle->red)
+			{
+				z->parent->red = false;
+				uncle->red = false;
+				grandparent->red = true;
+				z = grandparent;
+			}
+
+			else
+			{
+				// Case 2: z is an inner child, rotate it to the outside
+				if (z == z->parent->right)
+				{
+					z = z->parent;
+					rotateLeft(z);
+				}
+
+				// Case 3: z is an outer child
+				z->parent->red = false;
+				grandparent->red = true;
+				rotateRight(grandparent);
+			}
+		}
+
+		else  // Mirror image of the above
+		{
+			Node *uncle = grandparent->left;
+
+			if (uncle != nullptr && uncle->red)
+			{
+				z->parent->red = false;
+				uncle->red = false;
+				grandparent->red = true;
+				z = grandparent;
+			}
+
+			else
+			{
+				if (z == z->parent->left)
+				{
+					z = z->parent;
+					rotateRight(z);
+				}
+
+				z->parent->red = false;
+				grandparent->red = true;
+				rotateLeft(grandparent);
+			}
+		}
+	}
+
+	m_root->red = false;
+}
+
+// Links nodes[begin, end) into a perfectly balanced subtree around the
+// middle element and returns its root. Every level above the deepest one is
+// full, so coloring only the deepest level red gives each path to a leaf
+// the same number of black nodes
+MultiMap::Node* MultiMap::linkBalanced(std::vector<Node*>& nodes, unsigned int begin,
+	unsigned int end, Node *parent, unsigned int depth, unsigned int maxDepth)
+{
+	if (begin >= end)
+		return nullptr;
+
+	unsigned int mid = begin + (end - begin) / 2;
+	Node *cur = nodes[mid];
+	cur->parent = parent;
+	cur->red = (depth == maxDepth && depth > 0);
+	cur->left = linkBalanced(nodes, begin, mid, cur, depth + 1, maxDepth);
+	cur->right = linkBalanced(nodes, mid + 1, end, cur, depth + 1, maxDepth);
+	updateSize(cur);
+
+	return cur;
 }
 
 ////////////////////
@@ -425,14 +619,8 @@ void MultiMap::testPrintBST(Node *cur)
 
 	testPrintBST(cur->left);
 
-	std::string curString = cur->key;
-	NodeList* tempNL = cur->val;
-	while (tempNL != nullptr)
-	{
-		unsigned int tempInt = tempNL->value;
-		std::cerr << curString << " : " << tempInt << std::endl;
-		tempNL = tempNL->next;
-	}
+	for (unsigned int i = 0; i < cur->numValues; i++)
+		std::cerr << cur->key << " : " << cur->values[i] << std::endl;
 
 	testPrintBST(cur->right);
 }
@@ -440,7 +628,7 @@ void MultiMap::testPrintBST(Node *cur)
 void MultiMap::Iterator::testIteratorPrint()
 {
 	if (valid())
-		std::cerr << m_ptrToNode->key << " : " << m_ptrToNode->val->value << std::endl;
+		std::cerr << m_ptrToNode->key << " : " << m_ptrToNode->values[m_valueIndex] << std::endl;
 	else
 		std::cerr << "Invalid iterator: check if key parameter is valid" << std::endl;
 }
@@ -2,37 +2,33 @@
 #define MULTIMAP_H
 
 #include <string>
+#include <vector>
 #include <iostream>
+#include "StringRef.h"
+#include "Arena.h"
 
 //template <typedef key, typedef value>
 class MultiMap
 {
 public:
 
-	struct NodeList
-	{
-		NodeList(unsigned int valueInput)
-		{
-			next = prev = nullptr;
-			value = valueInput;
-		}
-		unsigned int value;
-		NodeList *next, *prev;
-	};
-
+	// Nodes, their keys and their posting lists all live in the map's arena,
+	// so nothing in a node owns memory and the whole tree is freed at once
 	struct Node
 	{
-		Node(std::string keyInput, unsigned int valueInput) 
-		{ 
-			key = keyInput;
-			val = tail = new NodeList(valueInput);
-			duplicateTotal = 0;
-			left = right = parent = nullptr;
-		}
-		std::string key;
-		NodeList *val, *tail;
-		unsigned int duplicateTotal;
+		StringRef key;
+		// Posting list: every value inserted under key, in insertion order.
+		// Starts out as firstValue and moves to an arena array twice its size
+		// whenever it fills up
+		unsigned int *values;
+		unsigned int numValues;
+		unsigned int capacity;
+		unsigned int firstValue;
 		Node *left, *right, *parent;
+		bool red;
+		// Number of values (not keys) in the subtree rooted here, so ranks
+		// and range sizes can be read off a single descent
+		unsigned int size;
 	};
 
 	class Iterator
@@ -42,7 +38,7 @@ public:
 		Iterator(Node *init);
 		Iterator(Node *init, int x);
 		bool valid() const;
-		std::string getKey() const;
+		StringRef getKey() const;
 		unsigned int getValue() const;
 		bool next();
 		bool prev();
@@ -56,18 +52,22 @@ public:
 
 		// Private data members
 		Node *m_ptrToNode;
-		NodeList *m_ptrToNodeList;
+		unsigned int m_valueIndex;  // position in m_ptrToNode->values
 		bool m_valid;
-		unsigned int m_currentDuplicateValue;
 	};
 
 	MultiMap();
 	~MultiMap();
 	void clear();
-	void insert(std::string key, unsigned int value);
-	Iterator findEqual(std::string key) const;
-	Iterator findEqualOrSuccessor(std::string key) const;
-	Iterator findEqualOrPredecessor(std::string key) const;
+	void insert(const StringRef& key, unsigned int value);
+	void bulkLoad(const std::vector<std::pair<StringRef, unsigned int> >& sorted);
+	Iterator findEqual(const std::string& key) const;
+	Iterator findEqualOrSuccessor(const std::string& key) const;
+	Iterator findEqualOrPredecessor(const std::string& key) const;
+	unsigned int size() const;
+	unsigned int countLess(const std::string& key) const;
+	unsigned int countLessOrEqual(const std::string& key) const;
+	unsigned int countRange(const std::string& min, const std::string& max) const;
 
 	// Test printing
 	void testPrintInit();
@@ -79,11 +79,22 @@ private:
 	MultiMap& operator=(const MultiMap& rhs);
 
 	// Private methods
-	void clearBST(Node *cur) const;
-	void clearNodeList(Node *cur) const;
+	Node* newNode(const StringRef& key, unsigned int capacity);
+	void appendValue(Node *cur, unsigned int value);
+	unsigned int rank(const std::string& key, bool inclusive) const;
+	static unsigned int subtreeSize(const Node *cur);
+	static void updateSize(Node *cur);
+
+	// Red-black balancing (keeps height <= 2 log N regardless of insert order)
+	void rotateLeft(Node *x);
+	void rotateRight(Node *x);
+	void insertFixup(Node *z);
+	Node* linkBalanced(std::vector<Node*>& nodes, unsigned int begin, unsigned int end,
+		Node *parent, unsigned int depth, unsigned int maxDepth);
 
 	// Private data members
 	Node* m_root;
+	Arena m_arena;  // every node, key and posting list
 
 };
 
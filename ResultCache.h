@@ -0,0 +1,149 @@
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+
+// Least recently used cache of search results (see
+// Database::setResultCacheBudget), holding at most a budget of bytes. An
+// entry is the first rows of a search's order and how many matched in all.
+// It keeps the Criteria it was made from, so the owner can find the
+// entries a change affects with removeIf. Safe to use from several threads
+// at once: results are handed out as shared pointers, so evicting an entry
+// never pulls them from under a reader.
+template <typename Criteria>
+class ResultCache
+{
+public:
+	typedef std::shared_ptr<const std::vector<int> > Results;
+
+	ResultCache()
+	{
+		m_budget = 0;
+		m_used = 0;
+	}
+
+	// 0 turns the cache off. Evicts until what is cached fits
+	void setBudget(size_t bytes)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_budget = bytes;
+		evictToFit(0);
+	}
+
+	bool enabled() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_budget > 0;
+	}
+
+	void clear()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_entries.clear();
+		m_byKey.clear();
+		m_used = 0;
+	}
+
+	// Must be O(1). Null if key isn't cached
+	Results find(const std::string& key, unsigned int& numMatches)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		typename Index::iterator found = m_byKey.find(key);
+		if (found == m_byKey.end())
+			return Results();
+
+		// Now the most recently used
+		m_entries.splice(m_entries.begin(), m_entries, found->second);
+		numMatches = found->second->numMatches;
+		return found->second->results;
+	}
+
+	// Replaces what key had. criteriaBytes is what criteria holds on the heap,
+	// which only the owner knows how to count. Entries bigger than the whole
+	// budget are not kept
+	void insert(const std::string& key, const Criteria& criteria, size_t criteriaBytes,
+		const Results& results, unsigned int numMatches)
+	{
+		Entry entry;
+		entry.key = key;
+		entry.criteria = criteria;
+		entry.results = results;
+		entry.numMatches = numMatches;
+		entry.bytes = sizeof(Entry) + 2 * key.size() + criteriaBytes +
+			results->size() * sizeof(int);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		typename Index::iterator found = m_byKey.find(key);
+		if (found != m_byKey.end())
+			erase(found->second);
+
+		if (entry.bytes > m_budget)
+			return;
+
+		evictToFit(entry.bytes);
+		m_entries.push_front(entry);
+		m_byKey[key] = m_entries.begin();
+		m_used += entry.bytes;
+	}
+
+	// Drops every entry whose criteria affected(criteria) returns true for
+	template <typename Predicate>
+	void removeIf(Predicate affected)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		typename std::list<Entry>::iterator it = m_entries.begin();
+		while (it != m_entries.end())
+		{
+			if (affected(it->criteria))
+				it = erase(it);
+			else
+				++it;
+		}
+	}
+
+private:
+	struct Entry
+	{
+		std::string key;
+		Criteria criteria;
+		Results results;  // the first rows of the order, maybe all of them
+		unsigned int numMatches;
+		size_t bytes;  // roughly what the entry costs, counted against the budget
+	};
+
+	typedef std::unordered_map<std::string, typename std::list<Entry>::iterator> Index;
+
+	// Prevents ResultCaches from being copied or assigned
+	ResultCache(const ResultCache& other);
+	ResultCache& operator=(const ResultCache& rhs);
+
+	// Private methods
+	typename std::list<Entry>::iterator erase(typename std::list<Entry>::iterator it)
+	{
+		m_used -= it->bytes;
+		m_byKey.erase(it->key);
+		return m_entries.erase(it);
+	}
+
+	// Evicts least recently used entries until bytes more would fit
+	void evictToFit(size_t bytes)
+	{
+		while (!m_entries.empty() && m_used + bytes > m_budget)
+			erase(--m_entries.end());
+	}
+
+	// Private data members
+	mutable std::mutex m_mutex;
+	std::list<Entry> m_entries;  // most recently used first
+	Index m_byKey;
+	size_t m_budget;
+	size_t m_used;
+
+};
+
+#endif  // RESULTCACHE_H
@@ -0,0 +1,281 @@
+#include "RowBitmap.h"
+#include <algorithm>
+#include <iterator>  // for back_inserter
+
+// Number of set bits in a word
+static unsigned int popCount(unsigned long long word)
+{
+	word = word - ((word >> 1) & 0x5555555555555555ULL);
+	word = (word & 0x3333333333333333ULL) + ((word >> 2) & 0x3333333333333333ULL);
+	word = (word + (word >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	return static_cast<unsigned int>((word * 0x0101010101010101ULL) >> 56);
+}
+
+// Position of the lowest set bit of a non zero word (de Bruijn multiply)
+static unsigned int lowestBit(unsigned long long word)
+{
+	static const unsigned int POSITIONS[64] = {
+		0, 1, 56, 2, 57, 49, 28, 3, 61, 58, 42, 50, 38, 29, 17, 4,
+		62, 47, 59, 36, 45, 43, 51, 22, 53, 39, 33, 30, 24, 18, 12, 5,
+		63, 55, 48, 27, 60, 41, 37, 16, 46, 35, 44, 21, 52, 32, 23, 11,
+		54, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19, 9, 13, 8, 7, 6
+	};
+	return POSITIONS[((word & (0 - word)) * 0x03f79d71b4ca8b09ULL) >> 58];
+}
+
+// Must be O(1)
+RowBitmap::RowBitmap()
+{
+}
+
+void RowBitmap::clear()
+{
+	m_chunks.clear();
+}
+
+bool RowBitmap::empty() const
+{
+	return m_chunks.empty();
+}
+
+// Must be O(number of chunks)
+unsigned int RowBitmap::cardinality() const
+{
+	unsigned int total = 0;
+	for (unsigned int i = 0; i < m_chunks.size(); i++)
+		total += m_chunks[i].cardinality;
+	return total;
+}
+
+// Rows can be added in any order; adding a row twice has no effect. The
+// rows are bucketed by chunk first, so each chunk is filled in one go
+// instead of an insert at a time
+void RowBitmap::addRows(const std::vector<int>& rows)
+{
+	if (rows.empty())
+		return;
+
+	unsigned int maxHigh = 0;
+	for (unsigned int i = 0; i < rows.size(); i++)
+		maxHigh = std::max(maxHigh, static_cast<unsigned int>(rows[i]) >> 16);
+
+	// Counting sort of the lower halves by chunk
+	std::vector<unsigned int> starts(maxHigh + 2, 0);
+	for (unsigned int i = 0; i < rows.size(); i++)
+		starts[(static_cast<unsigned int>(rows[i]) >> 16) + 1]++;
+	for (unsigned int h = 1; h < starts.size(); h++)
+		starts[h] += starts[h - 1];
+
+	std::vector<unsigned short> lows(rows.size());
+	std::vector<unsigned int> next(starts.begin(), starts.end() - 1);
+	for (unsigned int i = 0; i < rows.size(); i++)
+		lows[next[static_cast<unsigned int>(rows[i]) >> 16]++] = static_cast<unsigned short>(rows[i] & 0xffff);
+
+	for (unsigned int high = 0; high <= maxHigh; high++)
+	{
+		unsigned int begin = starts[high];
+		unsigned int end = starts[high + 1];
+		if (begin == end)
+			continue;
+
+		Chunk *chunk = findChunk(high);
+		if (chunk->bits.empty() && chunk->cardinality + (end - begin) > ARRAY_LIMIT)
+			toBitset(*chunk);
+
+		if (!chunk->bits.empty())
+		{
+			for (unsigned int i = begin; i < end; i++)
+				chunk->bits[lows[i] >> 6] |= 1ULL << (lows[i] & 63);
+
+			chunk->cardinality = 0;
+			for (unsigned int w = 0; w < BITSET_WORDS; w++)
+				chunk->cardinality += popCount(chunk->bits[w]);
+
+			if (chunk->cardinality <= ARRAY_LIMIT)
+				toArray(*chunk);
+		}
+
+		else
+		{
+			chunk->array.insert(chunk->array.end(), lows.begin() + begin, lows.begin() + end);
+			std::sort(chunk->array.begin(), chunk->array.end());
+			chunk->array.erase(std::unique(chunk->array.begin(), chunk->array.end()),
+				chunk->array.end());
+			chunk->cardinality = chunk->array.size();
+		}
+	}
+}
+
+// Keeps only the rows that are also in other. Chunks only one side has are
+// dropped without looking inside them
+void RowBitmap::intersectWith(const RowBitmap& other)
+{
+	std::vector<Chunk> kept;
+	unsigned int i = 0;
+	unsigned int j = 0;
+
+	while (i < m_chunks.size() && j < other.m_chunks.size())
+	{
+		if (m_chunks[i].high < other.m_chunks[j].high)
+			i++;
+		else if (m_chunks[i].high > other.m_chunks[j].high)
+			j++;
+		else
+		{
+			intersectChunk(m_chunks[i], other.m_chunks[j]);
+			if (m_chunks[i].cardinality > 0)
+			{
+				kept.push_back(Chunk());
+				std::swap(kept.back(), m_chunks[i]);
+			}
+			i++;
+			j++;
+		}
+	}
+
+	m_chunks.swap(kept);
+}
+
+// Appends every row in increasing order
+void RowBitmap::toVector(std::vector<int>& rows) const
+{
+	rows.reserve(rows.size() + cardinality());
+
+	for (unsigned int c = 0; c < m_chunks.size(); c++)
+	{
+		const Chunk& chunk = m_chunks[c];
+		unsigned int base = chunk.high << 16;
+
+		if (chunk.bits.empty())
+		{
+			for (unsigned int i = 0; i < chunk.array.size(); i++)
+				rows.push_back(base | chunk.array[i]);
+			continue;
+		}
+
+		for (unsigned int w = 0; w < BITSET_WORDS; w++)
+		{
+			unsigned long long word = chunk.bits[w];
+			while (word != 0)
+			{
+				rows.push_back(base | (w << 6) | lowestBit(word));
+				word &= word - 1;
+			}
+		}
+	}
+}
+
+/////////////////////
+/* PRIVATE METHODS */
+/////////////////////
+
+// Index of the first chunk whose high is not below high
+unsigned int RowBitmap::lowerBoundChunk(unsigned int high) const
+{
+	unsigned int lo = 0;
+	unsigned int hi = m_chunks.size();
+	while (lo < hi)
+	{
+		unsigned int mid = lo + (hi - lo) / 2;
+		if (m_chunks[mid].high < high)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+// Creates the chunk if there is none for high yet
+RowBitmap::Chunk* RowBitmap::findChunk(unsigned int high)
+{
+	unsigned int pos = lowerBoundChunk(high);
+	if (pos == m_chunks.size() || m_chunks[pos].high != high)
+	{
+		Chunk chunk;
+		chunk.high = high;
+		chunk.cardinality = 0;
+		m_chunks.insert(m_chunks.begin() + pos, chunk);
+	}
+
+	return &m_chunks[pos];
+}
+
+void RowBitmap::toBitset(Chunk& chunk)
+{
+	chunk.bits.assign(BITSET_WORDS, 0);
+	for (unsigned int i = 0; i < chunk.array.size(); i++)
+		chunk.bits[chunk.array[i] >> 6] |= 1ULL << (chunk.array[i] & 63);
+
+	std::vector<unsigned short>().swap(chunk.array);
+}
+
+void RowBitmap::toArray(Chunk& chunk)
+{
+	chunk.array.clear();
+	chunk.array.reserve(chunk.cardinality);
+	for (unsigned int w = 0; w < BITSET_WORDS; w++)
+	{
+		unsigned long long word = chunk.bits[w];
+		while (word != 0)
+		{
+			chunk.array.push_back(static_cast<unsigned short>((w << 6) | lowestBit(word)));
+			word &= word - 1;
+		}
+	}
+
+	std::vector<unsigned long long>().swap(chunk.bits);
+}
+
+// chunk &= other, for every combination of array and bitset chunks
+void RowBitmap::intersectChunk(Chunk& chunk, const Chunk& other)
+{
+	bool chunkDense = !chunk.bits.empty();
+	bool otherDense = !other.bits.empty();
+
+	if (chunkDense && otherDense)
+	{
+		chunk.cardinality = 0;
+		for (unsigned int w = 0; w < BITSET_WORDS; w++)
+		{
+			chunk.bits[w] &= other.bits[w];
+			chunk.cardinality += popCount(chunk.bits[w]);
+		}
+
+		if (chunk.cardinality <= ARRAY_LIMIT)
+			toArray(chunk);
+		return;
+	}
+
+	// At least one side is an array, so the result is one too
+	std::vector<unsigned short> result;
+
+	if (chunkDense)
+	{
+		for (unsigned int i = 0; i < other.array.size(); i++)
+		{
+			unsigned short low = other.array[i];
+			if ((chunk.bits[low >> 6] >> (low & 63)) & 1)
+				result.push_back(low);
+		}
+		std::vector<unsigned long long>().swap(chunk.bits);
+	}
+
+	else if (otherDense)
+	{
+		for (unsigned int i = 0; i < chunk.array.size(); i++)
+		{
+			unsigned short low = chunk.array[i];
+			if ((other.bits[low >> 6] >> (low & 63)) & 1)
+				result.push_back(low);
+		}
+	}
+
+	else
+	{
+		std::set_intersection(chunk.array.begin(), chunk.array.end(),
+			other.array.begin(), other.array.end(), std::back_inserter(result));
+	}
+
+	chunk.array.swap(result);
+	chunk.cardinality = chunk.array.size();
+}
@@ -0,0 +1,47 @@
+#ifndef ROWBITMAP_H
+#define ROWBITMAP_H
+
+#include <vector>
+
+// Compressed set of row numbers, laid out the way roaring bitmaps are: rows
+// are grouped into chunks of 65536 by their upper 16 bits, and each chunk
+// keeps its lower 16 bits either as a sorted array while it holds few rows,
+// or as a 65536 bit bitset once the array would be bigger than that (8 KB).
+// Intersecting two sets works chunk by chunk on whichever forms they have.
+class RowBitmap
+{
+public:
+	RowBitmap();
+	void clear();
+	bool empty() const;
+	unsigned int cardinality() const;
+	void addRows(const std::vector<int>& rows);
+	void intersectWith(const RowBitmap& other);
+	void toVector(std::vector<int>& rows) const;
+
+private:
+	// Most rows an array chunk holds before it turns into a bitset
+	static const unsigned int ARRAY_LIMIT = 4096;
+	static const unsigned int BITSET_WORDS = 65536 / 64;
+
+	struct Chunk
+	{
+		unsigned int high;  // upper 16 bits shared by every row in the chunk
+		unsigned int cardinality;
+		std::vector<unsigned short> array;  // sorted, while sparse
+		std::vector<unsigned long long> bits;  // BITSET_WORDS words, once dense
+	};
+
+	// Private methods
+	unsigned int lowerBoundChunk(unsigned int high) const;
+	Chunk* findChunk(unsigned int high);
+	static void toBitset(Chunk& chunk);
+	static void toArray(Chunk& chunk);
+	static void intersectChunk(Chunk& chunk, const Chunk& other);
+
+	// Private data members
+	std::vector<Chunk> m_chunks;  // sorted by high
+
+};
+
+#endif  // ROWBITMAP_H
@@ -0,0 +1,79 @@
+#ifndef ROWCOMPARATOR_H
+#define ROWCOMPARATOR_H
+
+#include <vector>
+#include "ColumnStore.h"
+
+// Orders row numbers by a list of (column, direction) sort keys, comparing
+// the cells in place in the column store (typed columns by their parsed
+// values, dictionary encoded ones by their codes). Later keys only break
+// ties left by earlier ones.
+class RowComparator
+{
+public:
+	RowComparator(const ColumnStore& columns)
+	{
+		m_columns = &columns;
+	}
+
+	void addKey(unsigned int column, bool descending)
+	{
+		SortKey key;
+		key.column = column;
+		key.descending = descending;
+		key.typed = m_columns->getColumnType(column) != TypedValue::vt_string;
+		key.byCode = !key.typed && m_columns->isEncoded(column);
+		m_keys.push_back(key);
+	}
+
+	bool empty() const
+	{
+		return m_keys.empty();
+	}
+
+	// Negative, zero or positive like std::string::compare
+	int compare(int lhs, int rhs) const
+	{
+		for (unsigned int k = 0; k < m_keys.size(); k++)
+		{
+			int cmp;
+			if (m_keys[k].typed)
+			{
+				long long l = m_columns->getValue(lhs, m_keys[k].column);
+				long long r = m_columns->getValue(rhs, m_keys[k].column);
+				cmp = l < r ? -1 : (l > r ? 1 : 0);
+			}
+			else if (m_keys[k].byCode)
+				cmp = static_cast<int>(m_columns->getCode(lhs, m_keys[k].column)) -
+					static_cast<int>(m_columns->getCode(rhs, m_keys[k].column));
+			else
+				cmp = m_columns->getCell(lhs, m_keys[k].column).compare(
+					m_columns->getCell(rhs, m_keys[k].column));
+
+			if (cmp != 0)
+				return m_keys[k].descending ? -cmp : cmp;
+		}
+		return 0;
+	}
+
+	bool operator()(int lhs, int rhs) const
+	{
+		return compare(lhs, rhs) < 0;
+	}
+
+private:
+	struct SortKey
+	{
+		unsigned int column;
+		bool descending;
+		bool typed;
+		bool byCode;  // dictionary encoded strings compare by code
+	};
+
+	// Private data members
+	const ColumnStore *m_columns;
+	std::vector<SortKey> m_keys;
+
+};
+
+#endif  // ROWCOMPARATOR_H
@@ -0,0 +1,48 @@
+#ifndef ROWVIEW_H
+#define ROWVIEW_H
+
+#include "ColumnStore.h"
+
+// Read only view of one stored row. Its cells are StringRefs straight into
+// the column store, so reading a row copies and allocates nothing. Valid as
+// long as ColumnStore::getCell's views are (the next added row can move
+// any value that isn't read straight from a mapped file).
+class RowView
+{
+public:
+	RowView()
+	{
+		m_columns = nullptr;
+		m_rowNum = 0;
+	}
+
+	RowView(const ColumnStore& columns, unsigned int rowNum)
+	{
+		m_columns = &columns;
+		m_rowNum = rowNum;
+	}
+
+	unsigned int getRowNum() const
+	{
+		return m_rowNum;
+	}
+
+	unsigned int size() const
+	{
+		return m_columns == nullptr ? 0 : m_columns->getNumColumns();
+	}
+
+	// Must be O(1)
+	StringRef getCell(unsigned int column) const
+	{
+		return m_columns->getCell(m_rowNum, column);
+	}
+
+private:
+	// Private data members
+	const ColumnStore *m_columns;
+	unsigned int m_rowNum;
+
+};
+
+#endif  // ROWVIEW_H
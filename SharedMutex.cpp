@@ -0,0 +1,63 @@
+#include "SharedMutex.h"
+
+SharedMutex::ReadLock::ReadLock(SharedMutex& mutex)
+{
+	m_mutex = &mutex;
+	m_mutex->lockShared();
+}
+
+SharedMutex::ReadLock::~ReadLock()
+{
+	m_mutex->unlockShared();
+}
+
+SharedMutex::WriteLock::WriteLock(SharedMutex& mutex)
+{
+	m_mutex = &mutex;
+	m_mutex->lock();
+}
+
+SharedMutex::WriteLock::~WriteLock()
+{
+	m_mutex->unlock();
+}
+
+SharedMutex::SharedMutex()
+{
+	m_readers = 0;
+	m_waitingWriters = 0;
+	m_writing = false;
+}
+
+void SharedMutex::lock()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_waitingWriters++;
+	while (m_writing || m_readers > 0)
+		m_changed.wait(lock);
+	m_waitingWriters--;
+	m_writing = true;
+}
+
+void SharedMutex::unlock()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_writing = false;
+	m_changed.notify_all();
+}
+
+void SharedMutex::lockShared()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (m_writing || m_waitingWriters > 0)
+		m_changed.wait(lock);
+	m_readers++;
+}
+
+// Only the last reader out can let a writer in
+void SharedMutex::unlockShared()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (--m_readers == 0)
+		m_changed.notify_all();
+}
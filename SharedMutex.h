@@ -0,0 +1,62 @@
+#ifndef SHAREDMUTEX_H
+#define SHAREDMUTEX_H
+
+#include <mutex>
+#include <condition_variable>
+
+// Reader/writer lock: any number of threads can hold it shared at once, or
+// one thread exclusively. A waiting writer keeps new readers out, so a
+// steady stream of queries can't starve addRow. Not recursive: a thread
+// must not take it again while holding it, in either mode.
+class SharedMutex
+{
+public:
+	// Holds the lock shared for as long as it lives
+	class ReadLock
+	{
+	public:
+		ReadLock(SharedMutex& mutex);
+		~ReadLock();
+
+	private:
+		ReadLock(const ReadLock& other);
+		ReadLock& operator=(const ReadLock& rhs);
+
+		SharedMutex *m_mutex;
+	};
+
+	// Holds the lock exclusively for as long as it lives
+	class WriteLock
+	{
+	public:
+		WriteLock(SharedMutex& mutex);
+		~WriteLock();
+
+	private:
+		WriteLock(const WriteLock& other);
+		WriteLock& operator=(const WriteLock& rhs);
+
+		SharedMutex *m_mutex;
+	};
+
+	SharedMutex();
+	void lock();
+	void unlock();
+	void lockShared();
+	void unlockShared();
+
+private:
+	// Prevents SharedMutexes from being copied or assigned
+	SharedMutex(const SharedMutex& other);
+	SharedMutex& operator=(const SharedMutex& rhs);
+
+	// Private data members
+	std::mutex m_mutex;
+	std::condition_variable m_changed;  // a holder left
+	unsigned int m_readers;  // threads holding it shared
+	unsigned int m_waitingWriters;
+	bool m_writing;
+
+};
+
+#endif  // SHAREDMUTEX_H
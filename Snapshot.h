@@ -0,0 +1,124 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <ostream>
+#include <cstddef>
+#include <cstring>  // for memcpy
+
+// Reading and writing the pieces of a Database snapshot file (see
+// Database::saveSnapshot). Every array starts on an 8 byte boundary of the
+// file, so once the file is memory mapped (page aligned) each one can be
+// used in place as an array of its type.
+class SnapshotWriter
+{
+public:
+	SnapshotWriter(std::ostream& out)
+	{
+		m_out = &out;
+		m_position = 0;
+	}
+
+	void write(const void *data, size_t size)
+	{
+		m_out->write(static_cast<const char*>(data), size);
+		m_position += size;
+	}
+
+	void writeU32(unsigned int value)
+	{
+		write(&value, sizeof(value));
+	}
+
+	// Pads with zeros up to the next 8 byte boundary
+	void align()
+	{
+		static const char ZEROS[8] = { 0 };
+		write(ZEROS, (8 - m_position % 8) % 8);
+	}
+
+	bool good() const
+	{
+		return m_out->good();
+	}
+
+private:
+	// Private data members
+	std::ostream *m_out;
+	size_t m_position;
+
+};
+
+// Walks a snapshot held in memory. Every read checks it stays inside the
+// buffer and returns nullptr (or false) if it wouldn't
+class SnapshotReader
+{
+public:
+	SnapshotReader(const char *begin, const char *end)
+	{
+		m_begin = begin;
+		m_position = begin;
+		m_end = end;
+	}
+
+	// count elements of size bytes each, starting at the next 8 byte boundary
+	const void* readArray(size_t count, size_t size)
+	{
+		align();
+		if (size != 0 && count > static_cast<size_t>(m_end - m_position) / size)
+			return nullptr;
+
+		const char *result = m_position;
+		m_position += count * size;
+		return result;
+	}
+
+	bool readU32(unsigned int& value)
+	{
+		if (m_end - m_position < static_cast<ptrdiff_t>(sizeof(value)))
+			return false;
+
+		std::memcpy(&value, m_position, sizeof(value));
+		m_position += sizeof(value);
+		return true;
+	}
+
+	const char* readBytes(size_t size)
+	{
+		if (size > static_cast<size_t>(m_end - m_position))
+			return nullptr;
+
+		const char *result = m_position;
+		m_position += size;
+		return result;
+	}
+
+	void align()
+	{
+		size_t padding = (8 - (m_position - m_begin) % 8) % 8;
+		m_position = padding < static_cast<size_t>(m_end - m_position) ? m_position + padding : m_end;
+	}
+
+	// Must be O(count). True if offsets[0, count] start at 0 and never go
+	// down, so every range they mark lies in the first offsets[count] bytes
+	static bool validOffsets(const unsigned int *offsets, unsigned int count)
+	{
+		if (offsets[0] != 0)
+			return false;
+
+		for (unsigned int i = 0; i < count; i++)
+		{
+			if (offsets[i + 1] < offsets[i])
+				return false;
+		}
+		return true;
+	}
+
+private:
+	// Private data members
+	const char *m_begin;
+	const char *m_position;
+	const char *m_end;
+
+};
+
+#endif  // SNAPSHOT_H
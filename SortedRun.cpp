@@ -0,0 +1,140 @@
+#include "SortedRun.h"
+
+// Must be O(1)
+SortedRun::Iterator::Iterator()
+{
+	m_run = nullptr;
+	m_position = 0;
+	m_valid = false;
+}
+
+// Must be O(1)
+SortedRun::Iterator::Iterator(const SortedRun *run, unsigned int position)
+{
+	m_run = run;
+	m_position = position;
+	m_valid = position < run->m_count;
+}
+
+bool SortedRun::Iterator::valid() const
+{
+	return m_valid;
+}
+
+// Must be O(1)
+StringRef SortedRun::Iterator::getKey() const
+{
+	if (!valid())
+		return StringRef("ERROR");
+
+	return m_run->getKey(m_position);
+}
+
+unsigned int SortedRun::Iterator::getValue() const
+{
+	if (!valid())
+		return -1;
+
+	return m_run->getValue(m_position);
+}
+
+// Must be O(1). Duplicate keys are just neighbouring entries
+bool SortedRun::Iterator::next()
+{
+	if (!valid())
+		return false;
+
+	m_position++;
+	m_valid = m_position < m_run->m_count;
+	return m_valid;
+}
+
+bool SortedRun::Iterator::prev()
+{
+	if (!valid())
+		return false;
+
+	m_valid = m_position > 0;
+	if (m_valid)
+		m_position--;
+	return m_valid;
+}
+
+// Must be O(1). Nothing is copied, the arrays have to outlive the run
+SortedRun::SortedRun(const unsigned int *keyOffsets, const char *keyBytes,
+	const unsigned int *values, unsigned int count)
+{
+	m_keyOffsets = keyOffsets;
+	m_keyBytes = keyBytes;
+	m_values = values;
+	m_count = count;
+}
+
+// Must be O(log N). First value under key, like MultiMap::findEqual
+SortedRun::Iterator SortedRun::findEqual(const std::string& key) const
+{
+	unsigned int position = rank(key, false);
+	if (position < m_count && getKey(position) == StringRef(key))
+		return Iterator(this, position);
+	return Iterator();
+}
+
+// Must be O(log N)
+SortedRun::Iterator SortedRun::findEqualOrSuccessor(const std::string& key) const
+{
+	return Iterator(this, rank(key, false));
+}
+
+// Must be O(log N). Last value under the largest key <= key
+SortedRun::Iterator SortedRun::findEqualOrPredecessor(const std::string& key) const
+{
+	unsigned int position = rank(key, true);
+	if (position == 0)
+		return Iterator();
+	return Iterator(this, position - 1);
+}
+
+unsigned int SortedRun::size() const
+{
+	return m_count;
+}
+
+// Must be O(log N). Positions in a sorted run are ranks already
+unsigned int SortedRun::countLess(const std::string& key) const
+{
+	return rank(key, false);
+}
+
+unsigned int SortedRun::countLessOrEqual(const std::string& key) const
+{
+	return rank(key, true);
+}
+
+unsigned int SortedRun::countRange(const std::string& min, const std::string& max) const
+{
+	if (max < min)
+		return 0;
+
+	return countLessOrEqual(max) - countLess(min);
+}
+
+/////////////////////
+/* PRIVATE METHODS */
+/////////////////////
+
+// Number of entries with keys < key (<= key if inclusive)
+unsigned int SortedRun::rank(const StringRef& key, bool inclusive) const
+{
+	unsigned int lo = 0;
+	unsigned int hi = m_count;
+	while (lo < hi)
+	{
+		unsigned int mid = lo + (hi - lo) / 2;
+		int cmp = getKey(mid).compare(key);
+		if (cmp < 0 || (inclusive && cmp == 0))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
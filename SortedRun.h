@@ -0,0 +1,71 @@
+#ifndef SORTEDRUN_H
+#define SORTEDRUN_H
+
+#include <string>
+#include "StringRef.h"
+
+// Read only index over (key, value) entries that are already sorted by key
+// and then value, held in memory owned by someone else (a memory mapped
+// snapshot). Entry i has key keyBytes[keyOffsets[i], keyOffsets[i + 1]) and
+// value values[i]. Answers the same queries as MultiMap and BPlusTree with
+// binary searches, so an index can be used straight from the file.
+class SortedRun
+{
+public:
+	class Iterator
+	{
+	public:
+		Iterator();
+		Iterator(const SortedRun *run, unsigned int position);
+		bool valid() const;
+		StringRef getKey() const;
+		unsigned int getValue() const;
+		bool next();
+		bool prev();
+
+	private:
+		// Private data members
+		const SortedRun *m_run;
+		unsigned int m_position;
+		bool m_valid;
+	};
+
+	SortedRun(const unsigned int *keyOffsets, const char *keyBytes,
+		const unsigned int *values, unsigned int count);
+	Iterator findEqual(const std::string& key) const;
+	Iterator findEqualOrSuccessor(const std::string& key) const;
+	Iterator findEqualOrPredecessor(const std::string& key) const;
+	unsigned int size() const;
+	unsigned int countLess(const std::string& key) const;
+	unsigned int countLessOrEqual(const std::string& key) const;
+	unsigned int countRange(const std::string& min, const std::string& max) const;
+
+	// Must be O(1). Entry position of the run
+	StringRef getKey(unsigned int position) const
+	{
+		return StringRef(m_keyBytes + m_keyOffsets[position],
+			m_keyOffsets[position + 1] - m_keyOffsets[position]);
+	}
+
+	unsigned int getValue(unsigned int position) const
+	{
+		return m_values[position];
+	}
+
+private:
+	// Prevents SortedRuns from being copied or assigned
+	SortedRun(const SortedRun& other);
+	SortedRun& operator=(const SortedRun& rhs);
+
+	// Private methods
+	unsigned int rank(const StringRef& key, bool inclusive) const;
+
+	// Private data members
+	const unsigned int *m_keyOffsets;
+	const char *m_keyBytes;
+	const unsigned int *m_values;
+	unsigned int m_count;
+
+};
+
+#endif  // SORTEDRUN_H
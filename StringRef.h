@@ -0,0 +1,68 @@
+#ifndef STRINGREF_H
+#define STRINGREF_H
+
+#include <string>
+#include <cstring>
+#include <iostream>
+
+// Non owning view of a field value stored somewhere else (a column arena).
+// Only valid for as long as the storage it points into.
+struct StringRef
+{
+	StringRef()
+	{
+		data = "";
+		size = 0;
+	}
+	StringRef(const char *dataInput, unsigned int sizeInput)
+	{
+		data = dataInput;
+		size = sizeInput;
+	}
+	StringRef(const char *s)
+	{
+		data = s;
+		size = std::strlen(s);
+	}
+	StringRef(const std::string& s)
+	{
+		data = s.data();
+		size = s.size();
+	}
+
+	// Same ordering as std::string::compare (bytewise, shorter prefix first)
+	int compare(const StringRef& other) const
+	{
+		unsigned int common = size < other.size ? size : other.size;
+		int cmp = common == 0 ? 0 : std::memcmp(data, other.data, common);
+		if (cmp != 0)
+			return cmp;
+		if (size == other.size)
+			return 0;
+		return size < other.size ? -1 : 1;
+	}
+
+	bool empty() const { return size == 0; }
+	std::string str() const { return std::string(data, size); }
+
+	const char *data;
+	unsigned int size;
+};
+
+inline bool operator==(const StringRef& lhs, const StringRef& rhs)
+{
+	return lhs.size == rhs.size && lhs.compare(rhs) == 0;
+}
+
+inline bool operator!=(const StringRef& lhs, const StringRef& rhs) { return !(lhs == rhs); }
+inline bool operator<(const StringRef& lhs, const StringRef& rhs) { return lhs.compare(rhs) < 0; }
+inline bool operator>(const StringRef& lhs, const StringRef& rhs) { return lhs.compare(rhs) > 0; }
+inline bool operator<=(const StringRef& lhs, const StringRef& rhs) { return lhs.compare(rhs) <= 0; }
+inline bool operator>=(const StringRef& lhs, const StringRef& rhs) { return lhs.compare(rhs) >= 0; }
+
+inline std::ostream& operator<<(std::ostream& out, const StringRef& s)
+{
+	return out.write(s.data, s.size);
+}
+
+#endif  // STRINGREF_H
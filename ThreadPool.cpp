@@ -0,0 +1,127 @@
+#include "ThreadPool.h"
+#include <atomic>
+#include <memory>
+
+namespace
+{
+	// Shared between the caller of parallelFor and the helper tasks it queues.
+	// Helpers that only get to run after all the work was handed out just
+	// return, so the batch has to outlive the call (hence the shared_ptr)
+	struct Batch
+	{
+		Batch(unsigned int countInput, const std::function<void(unsigned int)>& bodyInput)
+			: body(bodyInput)
+		{
+			count = countInput;
+			nextIndex = 0;
+			finished = 0;
+		}
+
+		// Claims and runs indexes until there are none left
+		void work()
+		{
+			for (;;)
+			{
+				unsigned int i = nextIndex++;
+				if (i >= count)
+					return;
+
+				body(i);
+
+				if (++finished == count)
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					allDone.notify_all();
+				}
+			}
+		}
+
+		unsigned int count;
+		std::function<void(unsigned int)> body;
+		std::atomic<unsigned int> nextIndex;
+		std::atomic<unsigned int> finished;
+		std::mutex mutex;
+		std::condition_variable allDone;
+	};
+}
+
+ThreadPool::ThreadPool(unsigned int numWorkers)
+{
+	m_stopping = false;
+
+	for (unsigned int i = 0; i < numWorkers; i++)
+		m_workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_taskReady.notify_all();
+
+	for (unsigned int i = 0; i < m_workers.size(); i++)
+		m_workers[i].join();
+}
+
+unsigned int ThreadPool::getNumWorkers() const
+{
+	return m_workers.size();
+}
+
+void ThreadPool::parallelFor(unsigned int count, const std::function<void(unsigned int)>& body)
+{
+	if (count == 0)
+		return;
+
+	// Nothing to gain from handing a single item to another thread
+	if (count == 1 || m_workers.empty())
+	{
+		for (unsigned int i = 0; i < count; i++)
+			body(i);
+		return;
+	}
+
+	std::shared_ptr<Batch> batch = std::make_shared<Batch>(count, body);
+
+	// The calling thread works too, so one helper fewer than items is enough
+	unsigned int helpers = count - 1 < m_workers.size() ? count - 1 : m_workers.size();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (unsigned int i = 0; i < helpers; i++)
+			m_tasks.push([batch]() { batch->work(); });
+	}
+	m_taskReady.notify_all();
+
+	batch->work();
+
+	std::unique_lock<std::mutex> lock(batch->mutex);
+	while (batch->finished < count)
+		batch->allDone.wait(lock);
+}
+
+/////////////////////
+/* PRIVATE METHODS */
+/////////////////////
+
+void ThreadPool::workerLoop()
+{
+	for (;;)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			while (!m_stopping && m_tasks.empty())
+				m_taskReady.wait(lock);
+
+			if (m_stopping && m_tasks.empty())
+				return;
+
+			task = m_tasks.front();
+			m_tasks.pop();
+		}
+
+		task();
+	}
+}
@@ -0,0 +1,43 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Fixed set of worker threads shared by everything in a Database that can
+// run in parallel (loading, index builds, ...).
+class ThreadPool
+{
+public:
+	ThreadPool(unsigned int numWorkers);
+	~ThreadPool();
+	unsigned int getNumWorkers() const;
+
+	// Runs body(0) .. body(count - 1) across the workers and the calling
+	// thread, returning once every call has finished. The caller takes part
+	// in the work, so it is safe to call from inside another parallelFor and
+	// from several threads at once.
+	void parallelFor(unsigned int count, const std::function<void(unsigned int)>& body);
+
+private:
+	// Prevents ThreadPools from being copied or assigned
+	ThreadPool(const ThreadPool& other);
+	ThreadPool& operator=(const ThreadPool& rhs);
+
+	// Private methods
+	void workerLoop();
+
+	// Private data members
+	std::vector<std::thread> m_workers;
+	std::queue<std::function<void()> > m_tasks;
+	std::mutex m_mutex;
+	std::condition_variable m_taskReady;
+	bool m_stopping;
+
+};
+
+#endif  // THREADPOOL_H
@@ -0,0 +1,139 @@
+#include "TypedValue.h"
+#include <climits>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+const long long TypedValue::NULL_VALUE = LLONG_MIN;
+
+// Reads exactly minDigits to maxDigits decimal digits starting at pos
+static bool readDigits(const char *&pos, const char *end, unsigned int minDigits,
+	unsigned int maxDigits, int& number)
+{
+	unsigned int digits = 0;
+	number = 0;
+	while (pos < end && digits < maxDigits && *pos >= '0' && *pos <= '9')
+	{
+		number = number * 10 + (*pos - '0');
+		pos++;
+		digits++;
+	}
+	return digits >= minDigits;
+}
+
+static bool isLeapYear(int year)
+{
+	return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+// Days from 1970-01-01 to a (valid) proleptic Gregorian date
+static long long daysFromCivil(int year, int month, int day)
+{
+	year -= month <= 2;
+	long long era = (year >= 0 ? year : year - 399) / 400;
+	long long yearOfEra = year - era * 400;
+	long long dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	long long dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+	return era * 146097 + dayOfEra - 719468;
+}
+
+static bool parseDate(const char *pos, const char *end, long long& value)
+{
+	int year, month, day;
+
+	// YYYY-MM-DD
+	if (end - pos >= 5 && pos[4] == '-')
+	{
+		if (!readDigits(pos, end, 4, 4, year) || *pos++ != '-' ||
+			!readDigits(pos, end, 1, 2, month) || pos == end || *pos++ != '-' ||
+			!readDigits(pos, end, 1, 2, day))
+			return false;
+	}
+
+	// MM/DD/YYYY
+	else
+	{
+		if (!readDigits(pos, end, 1, 2, month) || pos == end || *pos++ != '/' ||
+			!readDigits(pos, end, 1, 2, day) || pos == end || *pos++ != '/' ||
+			!readDigits(pos, end, 4, 4, year))
+			return false;
+	}
+
+	if (pos != end || month < 1 || month > 12 || day < 1)
+		return false;
+
+	static const int DAYS_IN_MONTH[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	int monthLength = DAYS_IN_MONTH[month - 1] + (month == 2 && isLeapYear(year) ? 1 : 0);
+	if (day > monthLength)
+		return false;
+
+	value = daysFromCivil(year, month, day);
+	return true;
+}
+
+bool TypedValue::parse(Type type, const StringRef& text, long long& value)
+{
+	if (type == vt_date)
+		return parseDate(text.data, text.data + text.size, value);
+
+	// strtoll and strtod need a terminated string. Anything this long isn't
+	// a number anyway
+	char buffer[64];
+	if (text.size == 0 || text.size >= sizeof(buffer))
+		return false;
+	std::memcpy(buffer, text.data, text.size);
+	buffer[text.size] = '\0';
+
+	char *parsedEnd;
+	errno = 0;
+
+	if (type == vt_integer)
+	{
+		long long number = std::strtoll(buffer, &parsedEnd, 10);
+		if (*parsedEnd != '\0' || errno == ERANGE || number == NULL_VALUE)
+			return false;
+
+		value = number;
+		return true;
+	}
+
+	if (type == vt_decimal)
+	{
+		double number = std::strtod(buffer, &parsedEnd);
+		if (*parsedEnd != '\0' || number != number)  // NaN has no place in the order
+			return false;
+
+		// -0.0 and 0.0 have different bits but are the same value
+		if (number == 0.0)
+			number = 0.0;
+
+		// Positive doubles already order like their bits. Negative ones order
+		// backwards, so every bit but the sign is flipped
+		long long bits;
+		std::memcpy(&bits, &number, sizeof(bits));
+		if (bits < 0)
+			bits ^= LLONG_MAX;
+
+		value = bits;
+		return true;
+	}
+
+	return false;
+}
+
+void TypedValue::encodeKey(long long value, char *key)
+{
+	unsigned long long bits = static_cast<unsigned long long>(value) ^ (1ULL << 63);
+	for (int i = KEY_SIZE - 1; i >= 0; i--)
+	{
+		key[i] = static_cast<char>(bits & 0xff);
+		bits >>= 8;
+	}
+}
+
+std::string TypedValue::encodeKey(long long value)
+{
+	char key[KEY_SIZE];
+	encodeKey(value, key);
+	return std::string(key, KEY_SIZE);
+}
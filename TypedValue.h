@@ -0,0 +1,36 @@
+#ifndef TYPEDVALUE_H
+#define TYPEDVALUE_H
+
+#include <string>
+#include "StringRef.h"
+
+// Parsing and index key encoding for fields that aren't plain strings.
+// Every typed value is held as a long long, ordered the same way as the
+// values it stands for:
+//  - integers as themselves
+//  - dates (YYYY-MM-DD or MM/DD/YYYY) as days since 1970-01-01
+//  - decimals as the bits of the double, rearranged to compare as integers
+class TypedValue
+{
+public:
+	enum Type { vt_string, vt_integer, vt_decimal, vt_date };
+
+	// Stored for cells that don't parse. Sorts before every real value
+	static const long long NULL_VALUE;
+
+	// Size of an encoded index key
+	static const unsigned int KEY_SIZE = 8;
+
+	static bool parse(Type type, const StringRef& text, long long& value);
+
+	// Big endian with the sign bit flipped, so comparing keys bytewise (the
+	// way the field indexes compare strings) orders them like the values
+	static void encodeKey(long long value, char *key);
+	static std::string encodeKey(long long value);
+
+private:
+	// Only static members, never constructed
+	TypedValue();
+};
+
+#endif  // TYPEDVALUE_H
@@ -0,0 +1,327 @@
+#include "WriteAheadLog.h"
+#include "MappedFile.h"
+#include <cstring>  // for memcpy, memcmp
+
+#ifdef _MSC_VER  // Windows
+
+#include <windows.h>
+
+#else  //  Mac OS X and LINUX
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#endif
+
+// File layout: the magic, then one record per row: the payload size, its
+// checksum and the payload (number of cells, then each cell's size and
+// bytes). Sizes are unsigned ints in the machine's byte order
+static const char LOG_MAGIC[8] = { 'C', 'S', '3', '2', 'W', 'A', 'L', '1' };
+
+// FNV-1a, enough to tell a torn record from a whole one
+static unsigned int checksum(const char *data, size_t size)
+{
+	unsigned int hash = 2166136261u;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= static_cast<unsigned char>(data[i]);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static void appendU32(std::string& out, unsigned int value)
+{
+	out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Reads an unsigned int at pos if one fits before end
+static bool readU32(const char *&pos, const char *end, unsigned int& value)
+{
+	if (static_cast<size_t>(end - pos) < sizeof(value))
+		return false;
+
+	std::memcpy(&value, pos, sizeof(value));
+	pos += sizeof(value);
+	return true;
+}
+
+// True only if filename is known not to exist. Any other reason a file
+// can't be read (permissions, too big to map) is not a reason to replace it
+static bool fileMissing(const std::string& filename)
+{
+#ifdef _MSC_VER
+	return GetFileAttributesA(filename.c_str()) == INVALID_FILE_ATTRIBUTES &&
+		GetLastError() == ERROR_FILE_NOT_FOUND;
+#else
+	struct stat st;
+	return stat(filename.c_str(), &st) != 0 && errno == ENOENT;
+#endif
+}
+
+WriteAheadLog::WriteAheadLog()
+{
+	m_rowsPerSync = 1;
+	m_unsynced = 0;
+	m_open = false;
+	m_failed = false;
+#ifdef _MSC_VER
+	m_fileHandle = nullptr;
+#else
+	m_fd = -1;
+#endif
+}
+
+WriteAheadLog::~WriteAheadLog()
+{
+	close();
+}
+
+bool WriteAheadLog::open(const std::string& filename, unsigned int rowsPerSync,
+	const std::function<bool(const std::vector<std::string>&)>& replay)
+{
+	close();
+
+	// Replay whatever is already there, and find where its last whole
+	// record ends. Only a log that doesn't exist yet starts out empty: one
+	// that exists but can't be read is left alone
+	size_t validSize = 0;
+	bool exists = true;
+	MappedFile existing;
+	if (existing.open(filename, MappedFile::ap_sequential))
+	{
+		if (existing.size() > 0)
+		{
+			if (existing.size() < sizeof(LOG_MAGIC) ||
+				std::memcmp(existing.data(), LOG_MAGIC, sizeof(LOG_MAGIC)) != 0)
+				return false;
+
+			bool stopped;
+			validSize = sizeof(LOG_MAGIC) + readRecords(existing.data() + sizeof(LOG_MAGIC),
+				existing.size() - sizeof(LOG_MAGIC), replay, stopped);
+			if (stopped)
+				return false;
+		}
+	}
+	else if (fileMissing(filename))
+		exists = false;
+	else
+		return false;
+	existing.close();
+
+	// Cut off a torn last record, so new records follow the whole ones. A
+	// new log is created exclusively, so a file that showed up since the
+	// check above is never truncated
+#ifdef _MSC_VER
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL,
+		exists ? OPEN_EXISTING : CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER position;
+	position.QuadPart = static_cast<LONGLONG>(validSize);
+	if (!SetFilePointerEx(file, position, NULL, FILE_BEGIN) || !SetEndOfFile(file))
+	{
+		CloseHandle(file);
+		return false;
+	}
+	m_fileHandle = file;
+#else
+	int fd = ::open(filename.c_str(), exists ? O_WRONLY : O_WRONLY | O_CREAT | O_EXCL, 0644);
+	if (fd < 0)
+		return false;
+
+	if (ftruncate(fd, static_cast<off_t>(validSize)) != 0 ||
+		lseek(fd, 0, SEEK_END) < 0)
+	{
+		::close(fd);
+		return false;
+	}
+	m_fd = fd;
+#endif
+
+	m_open = true;
+	m_rowsPerSync = rowsPerSync > 0 ? rowsPerSync : 1;
+	m_unsynced = 0;
+
+	if (validSize == 0 && (!writeBytes(LOG_MAGIC, sizeof(LOG_MAGIC)) || !sync()))
+	{
+		close();
+		return false;
+	}
+
+	m_failed = false;
+	return true;
+}
+
+void WriteAheadLog::close()
+{
+	if (!m_open)
+		return;
+
+	sync();
+	closeFile();
+}
+
+bool WriteAheadLog::isOpen() const
+{
+	return m_open;
+}
+
+bool WriteAheadLog::failed() const
+{
+	return m_failed;
+}
+
+// A row that can't be written whole fails the log: anything after a torn
+// record would be dropped on the next open anyway. A row that was written
+// but whose group sync then failed is still appended (the next open replays
+// it, so it is true it was logged); the log fails and sync reports it
+bool WriteAheadLog::append(const std::vector<std::string>& row)
+{
+	if (!m_open)
+		return false;
+
+	m_record.assign(2 * sizeof(unsigned int), '\0');
+	appendU32(m_record, row.size());
+	for (unsigned int i = 0; i < row.size(); i++)
+	{
+		appendU32(m_record, row[i].size());
+		m_record += row[i];
+	}
+
+	const char *payload = m_record.data() + 2 * sizeof(unsigned int);
+	unsigned int payloadSize = m_record.size() - 2 * sizeof(unsigned int);
+	unsigned int payloadChecksum = checksum(payload, payloadSize);
+	std::memcpy(&m_record[0], &payloadSize, sizeof(payloadSize));
+	std::memcpy(&m_record[sizeof(payloadSize)], &payloadChecksum, sizeof(payloadChecksum));
+
+	if (!writeBytes(m_record.data(), m_record.size()))
+	{
+		fail();
+		return false;
+	}
+
+	m_unsynced++;
+	if (m_unsynced >= m_rowsPerSync)
+		sync();
+	return true;
+}
+
+bool WriteAheadLog::sync()
+{
+	if (!m_open || m_unsynced == 0)
+		return m_open;
+
+#ifdef _MSC_VER
+	bool flushed = FlushFileBuffers(m_fileHandle) != 0;
+#else
+	bool flushed = fsync(m_fd) == 0;
+#endif
+
+	// What was written may or may not be on the disk now, so no more rows
+	// are taken until the log is opened (and its records checked) again
+	if (!flushed)
+	{
+		fail();
+		return false;
+	}
+
+	m_unsynced = 0;
+	return true;
+}
+
+/////////////////////
+/* PRIVATE METHODS */
+/////////////////////
+
+// Closes the file without syncing it
+void WriteAheadLog::closeFile()
+{
+	if (!m_open)
+		return;
+
+#ifdef _MSC_VER
+	CloseHandle(m_fileHandle);
+	m_fileHandle = nullptr;
+#else
+	::close(m_fd);
+	m_fd = -1;
+#endif
+
+	m_open = false;
+}
+
+// Closes the file and refuses rows until the log is opened again, so a
+// caller never goes on without the log it asked for
+void WriteAheadLog::fail()
+{
+	closeFile();
+	m_failed = true;
+}
+
+// Returns how many bytes of whole, intact records there are. stopped is set
+// if replay asked to stop
+size_t WriteAheadLog::readRecords(const char *data, size_t size,
+	const std::function<bool(const std::vector<std::string>&)>& replay, bool& stopped)
+{
+	const char *pos = data;
+	const char *end = data + size;
+	std::vector<std::string> row;
+	stopped = false;
+
+	for (;;)
+	{
+		const char *record = pos;
+		unsigned int payloadSize, payloadChecksum, numCells;
+		if (!readU32(pos, end, payloadSize) || !readU32(pos, end, payloadChecksum) ||
+			static_cast<size_t>(end - pos) < payloadSize ||
+			checksum(pos, payloadSize) != payloadChecksum)
+			return record - data;
+
+		const char *payloadEnd = pos + payloadSize;
+		if (!readU32(pos, payloadEnd, numCells))
+			return record - data;
+
+		row.resize(numCells);
+		for (unsigned int i = 0; i < numCells; i++)
+		{
+			unsigned int cellSize;
+			if (!readU32(pos, payloadEnd, cellSize) ||
+				static_cast<size_t>(payloadEnd - pos) < cellSize)
+				return record - data;
+
+			row[i].assign(pos, cellSize);
+			pos += cellSize;
+		}
+
+		if (!replay(row))
+		{
+			stopped = true;
+			return record - data;
+		}
+
+		pos = payloadEnd;
+	}
+}
+
+bool WriteAheadLog::writeBytes(const char *data, size_t size)
+{
+	while (size > 0)
+	{
+#ifdef _MSC_VER
+		DWORD written;
+		if (!WriteFile(m_fileHandle, data, static_cast<DWORD>(size), &written, NULL))
+			return false;
+#else
+		ssize_t written = ::write(m_fd, data, size);
+		if (written < 0)
+			return false;
+#endif
+		data += written;
+		size -= written;
+	}
+	return true;
+}
@@ -0,0 +1,57 @@
+#ifndef WRITEAHEADLOG_H
+#define WRITEAHEADLOG_H
+
+#include <string>
+#include <vector>
+#include <functional>
+
+// Append only file of rows, one checksummed record per row. Every record is
+// written to the file as soon as it is appended, but only flushed to the
+// disk once rowsPerSync of them are waiting (group commit), so a crash of
+// the machine can lose at most the last rowsPerSync - 1 rows. A record cut
+// short by a crash is dropped (and cut off the file) the next time the log
+// is opened.
+class WriteAheadLog
+{
+public:
+	WriteAheadLog();
+	~WriteAheadLog();  // syncs and closes
+	// Calls replay with every row already in the file (creating it if it
+	// doesn't exist), in the order they were appended, then opens it for
+	// appending. Stops and returns false if replay returns false, and
+	// without touching the file if it exists but can't be read
+	bool open(const std::string& filename, unsigned int rowsPerSync,
+		const std::function<bool(const std::vector<std::string>&)>& replay);
+	void close();
+	bool isOpen() const;
+	bool failed() const;  // a write or sync failed: closed until open succeeds
+	bool append(const std::vector<std::string>& row);  // false only if the row isn't in the file
+	bool sync();  // flushes every appended row to the disk now, false once failed
+
+private:
+	// Prevents WriteAheadLogs from being copied or assigned
+	WriteAheadLog(const WriteAheadLog& other);
+	WriteAheadLog& operator=(const WriteAheadLog& rhs);
+
+	// Private methods
+	void closeFile();
+	void fail();
+	static size_t readRecords(const char *data, size_t size,
+		const std::function<bool(const std::vector<std::string>&)>& replay, bool& stopped);
+	bool writeBytes(const char *data, size_t size);
+
+	// Private data members
+	std::string m_record;  // reused for every append
+	unsigned int m_rowsPerSync;
+	unsigned int m_unsynced;  // rows written since the last sync
+	bool m_open;
+	bool m_failed;
+#ifdef _MSC_VER
+	void *m_fileHandle;
+#else
+	int m_fd;
+#endif
+
+};
+
+#endif  // WRITEAHEADLOG_H
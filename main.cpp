@@ -3,6 +3,8 @@
 #include <iostream>
 #include <string>
 #include <cassert>
+#include <fstream>
+#include <chrono>
 
 // Database tests
 bool setSchema(Database& db);
@@ -11,14 +13,14 @@ bool addFromInternet(Database& db, std::string url);
 bool addFromFile(Database& db, std::string fileName);
 void doAQuery(Database &db);
 
+// Index engine benchmark
+void benchmarkIndexEngines(std::string fileName, unsigned int fieldNum);
+
 // MultiMap tests (BROKEN)
 void initMultiMapTest();
 void findEqualTests(MultiMap test);
 void nextIteratorTest(MultiMap test);
 
-/* KNOWN BUGS */
-// - Having more than 1 sort criterion will have some results out of order (See AYERS OFELIA)
-
 int main()
 {
 	/* TEST LOAD FROM RUNTIME ENVIRONMENT */
@@ -59,6 +61,9 @@ int main()
 	/* TEST PRINT BINARY SEARCH TREE*/
 	//assert(A.printBST());
 
+	/* BENCHMARK MULTIMAP VS B+ TREE ON THE LAST NAME COLUMN AND ON TWO KEYS */
+	//benchmarkIndexEngines(fileNames[2], 1);
+
 	/* TEST DO A DATABASE QUERY */
 	doAQuery(C);
 	
@@ -85,6 +90,7 @@ bool setSchema(Database& db)
 
 	fd3.name = "age";
 	fd3.index = Database::it_none;
+	fd3.type = Database::ft_integer;
 
 	std::vector<Database::FieldDescriptor> schema;
 	schema.push_back(fd1);
@@ -99,7 +105,7 @@ bool addARow(Database& db)
 	std::vector<std::string> row;
 	row.push_back("Daniel");
 	row.push_back("310-439-2932");
-	row.push_back("0035");
+	row.push_back("35");
 
 	return db.addRow(row);
 }
@@ -152,7 +158,7 @@ void doAQuery(Database& db)
 	Database::SearchCriterion s2;
 	s2.fieldName = "Age";
 	s2.minValue = "";  // No minimum specified
-	s2.maxValue = "099";
+	s2.maxValue = "099";  // Padded like the file's ages, right whether or not Age is typed
 
 	Database::SearchCriterion s3;
 	s3.fieldName = "FirstName";
@@ -193,12 +199,12 @@ void doAQuery(Database& db)
 			// Print the row number out where we had a match
 			std::cerr << "Row #" << results[i] << ": ";
 
-			// Get and print the field values out from that row
-			std::vector<std::string> rowData;
-			if (db.getRow(results[i], rowData))
+			// Print the field values out from that row, straight from the database
+			RowView rowData;
+			if (db.getRowView(results[i], rowData))
 			{
-				for (size_t j = 0; j < rowData.size(); j++)
-					std::cerr << rowData[j] << " ";
+				for (unsigned int j = 0; j < rowData.size(); j++)
+					std::cerr << rowData.getCell(j) << " ";
 				std::cerr << std::endl;
 			}
 			else
@@ -207,6 +213,78 @@ void doAQuery(Database& db)
 	}
 }
 
+// Builds one index per engine from a single column of a census style CSV file
+// then times the build and a set of range scans over it
+void benchmarkIndexEngines(std::string fileName, unsigned int fieldNum)
+{
+	std::ifstream infile(fileName);
+	if (!infile)
+	{
+		std::cerr << "Error opening " << fileName << std::endl;
+		return;
+	}
+
+	// Skip the header line and keep only the requested column
+	std::string line, word;
+	std::vector<std::string> column;
+	std::getline(infile, line);
+	while (std::getline(infile, line))
+	{
+		Tokenizer t(line, ",");
+		for (unsigned int i = 0; t.getNextToken(word); i++)
+		{
+			if (i == fieldNum)
+				column.push_back(word);
+		}
+	}
+
+	// The same number of rows again under just two keys, like Married, so
+	// every insert after the first two is a duplicate
+	std::vector<std::string> duplicates(column.size());
+	for (unsigned int i = 0; i < duplicates.size(); i++)
+		duplicates[i] = i % 2 == 0 ? "N" : "Y";
+
+	const char* columnNames[] = { "column", "two keys" };
+	const std::vector<std::string>* columns[] = { &column, &duplicates };
+	const char* engineNames[] = { "MultiMap", "B+ tree" };
+	FieldIndex::Engine engines[] = { FieldIndex::e_multiMap, FieldIndex::e_bPlusTree };
+	const std::string rangeStarts[] = { "", "A", "F", "M", "S" };
+
+	for (int c = 0; c < 2; c++)
+	{
+		const std::vector<std::string>& keys = *columns[c];
+
+		for (int e = 0; e < 2; e++)
+		{
+			FieldIndex index(engines[e]);
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (unsigned int i = 0; i < keys.size(); i++)
+				index.insert(keys[i], i);
+			std::chrono::steady_clock::time_point built = std::chrono::steady_clock::now();
+
+			// Each pass scans every row from a handful of different starting keys
+			unsigned long long checksum = 0;
+			for (int pass = 0; pass < 20; pass++)
+			{
+				for (int r = 0; r < 5; r++)
+				{
+					FieldIndex::Iterator it = index.findEqualOrSuccessor(rangeStarts[r]);
+					for (; it.valid(); it.next())
+						checksum += it.getValue();
+				}
+			}
+			std::chrono::steady_clock::time_point scanned = std::chrono::steady_clock::now();
+
+			std::cerr << engineNames[e] << " (" << columnNames[c] << "): " << keys.size() <<
+				" rows, build " <<
+				std::chrono::duration_cast<std::chrono::milliseconds>(built - start).count() << " ms, scans " <<
+				std::chrono::duration_cast<std::chrono::milliseconds>(scanned - built).count() << " ms (checksum " <<
+				checksum << ")" << std::endl;
+		}
+	}
+}
+
 void initMultiMapTest()
 {
 	MultiMap test;